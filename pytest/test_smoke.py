@@ -0,0 +1,68 @@
+# Copyright (c) 2024 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Smoke test of the native_sim build, run by twister.
+
+Opens the HCI PTY that native_sim prints on startup and talks H4 to the
+application and the stub controller with the host side of
+scripts/h4_bench.py.
+"""
+
+import os
+import re
+import struct
+import sys
+import time
+
+from twister_harness import DeviceAdapter
+
+sys.path.insert(0, os.path.join(os.path.dirname(__file__), '..', 'scripts'))
+import h4_bench  # noqa: E402
+
+PTY_RE = r'uart connected to pseudotty: (/dev/pts/\d+)'
+
+STATUS_SUCCESS = 0x00
+STATUS_UNKNOWN_CMD = 0x01
+
+EVT_NUM_COMPLETED_PACKETS = 0x13
+
+
+def open_host(dut):
+    lines = dut.readlines_until(regex=PTY_RE, timeout=10)
+    pty = re.search(PTY_RE, lines[-1]).group(1)
+    return h4_bench.Host(h4_bench.H4Port(pty, 1000000, False))
+
+
+def test_commands(dut: DeviceAdapter):
+    host = open_host(dut)
+
+    rsp, _, _ = host.command(h4_bench.OP_RESET)
+    assert rsp[0] == STATUS_SUCCESS
+
+    # Answered by the stub controller
+    rsp, _, _ = host.command(h4_bench.OP_READ_LOCAL_VERSION)
+    assert rsp[0] == STATUS_UNKNOWN_CMD
+
+    # Answered by the application, controller time is the system clock
+    times = []
+    for _ in range(2):
+        rsp, _, _ = host.command(h4_bench.OP_TIMESYNC, bytes([0x01]))
+        assert rsp[0] == STATUS_SUCCESS
+        times.append(struct.unpack_from('<Q', rsp, 2)[0])
+        time.sleep(0.01)
+    assert times[1] > times[0]
+
+
+def test_acl_loopback(dut: DeviceAdapter):
+    host = open_host(dut)
+    packet = h4_bench.data_packet('acl', 1, 27)
+    received = []
+
+    host.port.queue(packet)
+    deadline = time.monotonic() + 1.0
+    while len(received) < 2 and time.monotonic() < deadline:
+        received += [p for _, p, _ in host.port.poll(0.01)]
+
+    assert received[0] == packet
+    assert received[1][:2] == bytes([h4_bench.H4_EVT, EVT_NUM_COMPLETED_PACKETS])
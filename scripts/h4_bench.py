@@ -0,0 +1,541 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""H4 transport benchmark for the HCI UART application.
+
+Pumps a mix of HCI commands, ACL and ISO packets at a board or at the
+native_sim PTY and measures throughput per direction, latency percentiles
+and drops. The firmware needs CONFIG_HCI_UART_BENCH (overlay-bench.conf),
+which loops the data back or drops it instead of passing it to the
+controller, and writes the controller time at which it would have called
+bt_send() into the first 8 payload bytes. With --mode controller, the data
+is passed on and comes back from the native_sim stub controller through
+the same path as received data. The controller time is mapped to
+host time by timesync commands before and after the run, which splits the
+round trip into the host to controller and controller to host latencies.
+
+  h4_bench.py run --port /dev/pts/3 --mix acl:8,iso:2,cmd:1 --out after.json
+  h4_bench.py compare before.json after.json
+
+The profile command sends timesync commands and reads the cycle profile of
+the firmware (CONFIG_HCI_UART_PROF), for before and after comparisons of
+the hot paths. run --profile reads it after a data run.
+
+Only the Python standard library is used.
+"""
+
+import argparse
+import json
+import os
+import select
+import struct
+import sys
+import termios
+import time
+import tty
+
+H4_CMD = 0x01
+H4_ACL = 0x02
+H4_EVT = 0x04
+H4_ISO = 0x05
+
+EVT_CMD_COMPLETE = 0x0e
+EVT_CMD_STATUS = 0x0f
+
+BENCH_MODES = {'off': 0, 'loopback': 1, 'sink': 2, 'controller': 3}
+
+TRANSPORT_STATS_FIELDS = (
+    'h2c_bytes', 'h2c_packets', 'h2c_alloc_failures', 'h2c_discarded',
+    'h2c_unknown_type', 'h2c_send_errors', 'h2c_queue_max',
+    'c2h_bytes', 'c2h_packets', 'c2h_evt_drops', 'c2h_queue_max',
+    'time_recaptures', 'time_stale_captures')
+
+# Controller time (8 octets, written by the firmware) and sequence number
+PAYLOAD_HDR = struct.Struct('<QI')
+
+ACL_HANDLE = 0x0001
+ISO_HANDLE = 0x0002
+ISO_PB_SINGLE = 0x2
+
+PERCENTILES = (50, 99, 99.9)
+
+
+def op(ogf, ocf):
+    return (ogf << 10) | ocf
+
+
+OP_RESET = op(0x03, 0x003)
+OP_READ_LOCAL_VERSION = op(0x04, 0x001)
+OP_TIMESYNC = op(0x3f, 0x200)
+OP_TRANSPORT_STATS = op(0x3f, 0x205)
+OP_TRANSPORT_BENCH = op(0x3f, 0x206)
+OP_READ_PROFILE = op(0x3f, 0x207)
+
+PROF_POINTS = ('rx_isr', 'tx_isr', 'bt_send', 'timesync_locked', 'timesync_response',
+               'trace_write')
+# Point, cycles per second, count, min, max, sum
+PROF_HDR = struct.Struct('<BIIIIQ')
+PROF_HIST_BINS = 16
+
+
+def now_ns():
+    return time.monotonic_ns()
+
+
+class H4Port:
+    """Non-blocking H4 framing on a serial port or PTY."""
+
+    def __init__(self, path, baud, rtscts):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY | os.O_NONBLOCK)
+        if os.isatty(self.fd):
+            tty.setraw(self.fd)
+            attrs = termios.tcgetattr(self.fd)
+            speed = getattr(termios, 'B%d' % baud, None)
+            if speed is None:
+                raise ValueError('unsupported baud rate %d' % baud)
+            attrs[4] = attrs[5] = speed
+            if rtscts:
+                attrs[2] |= termios.CRTSCTS
+            else:
+                attrs[2] &= ~termios.CRTSCTS
+            termios.tcsetattr(self.fd, termios.TCSANOW, attrs)
+            termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.rx = bytearray()
+        self.tx = bytearray()
+        # Packets queued for writing: (end offset in the stream, callback)
+        self.tx_marks = []
+        self.tx_written = 0
+        self.tx_queued = 0
+
+    def close(self):
+        os.close(self.fd)
+
+    def queue(self, packet, on_written=None):
+        self.tx += packet
+        self.tx_queued += len(packet)
+        if on_written:
+            self.tx_marks.append((self.tx_queued, on_written))
+
+    def poll(self, timeout):
+        """Write what the port takes, read what arrived.
+
+        Returns the list of complete packets as (type, packet, time).
+        """
+        wlist = [self.fd] if self.tx else []
+        readable, writable, _ = select.select([self.fd], wlist, [], timeout)
+        packets = []
+
+        if writable:
+            try:
+                n = os.write(self.fd, self.tx)
+            except BlockingIOError:
+                n = 0
+            if n:
+                t = now_ns()
+                del self.tx[:n]
+                self.tx_written += n
+                while self.tx_marks and self.tx_marks[0][0] <= self.tx_written:
+                    self.tx_marks.pop(0)[1](t)
+
+        if readable:
+            try:
+                data = os.read(self.fd, 65536)
+            except BlockingIOError:
+                data = b''
+            t = now_ns()
+            self.rx += data
+            while True:
+                packet = self._parse()
+                if packet is None:
+                    break
+                packets.append((packet[0], packet, t))
+
+        return packets
+
+    def _parse(self):
+        if not self.rx:
+            return None
+        h4_type = self.rx[0]
+        if h4_type == H4_EVT:
+            if len(self.rx) < 3:
+                return None
+            total = 3 + self.rx[2]
+        elif h4_type in (H4_ACL, H4_ISO):
+            if len(self.rx) < 5:
+                return None
+            total = 5 + (struct.unpack_from('<H', self.rx, 3)[0] & 0x3fff)
+        else:
+            raise IOError('lost H4 framing, type 0x%02x' % h4_type)
+        if len(self.rx) < total:
+            return None
+        packet = bytes(self.rx[:total])
+        del self.rx[:total]
+        return packet
+
+
+class Host:
+    """Sends commands one at a time and dispatches everything else."""
+
+    def __init__(self, port):
+        self.port = port
+        self.on_packet = None
+
+    def command(self, opcode, params=b'', timeout=1.0):
+        """Send a command, return (return parameters, sent time, complete time)."""
+        sent = {}
+        self.port.queue(struct.pack('<BHB', H4_CMD, opcode, len(params)) + params,
+                        lambda t: sent.setdefault('t', t))
+        deadline = time.monotonic() + timeout
+        while time.monotonic() < deadline:
+            for h4_type, packet, t in self.port.poll(0.01):
+                rsp = self._complete(packet, opcode)
+                if rsp is not None:
+                    return rsp, sent.get('t', t), t
+                if self.on_packet:
+                    self.on_packet(h4_type, packet, t)
+        raise TimeoutError('no response to command 0x%04x' % opcode)
+
+    @staticmethod
+    def _complete(packet, opcode):
+        if packet[0] != H4_EVT:
+            return None
+        if packet[1] == EVT_CMD_COMPLETE and struct.unpack_from('<H', packet, 4)[0] == opcode:
+            return packet[6:]
+        if packet[1] == EVT_CMD_STATUS and struct.unpack_from('<H', packet, 5)[0] == opcode:
+            return packet[3:4]
+        return None
+
+
+def timesync(host, rounds):
+    """Offset of controller time minus host time in ns.
+
+    The round with the shortest round trip is used, its uncertainty is
+    half of that round trip.
+    """
+    best = None
+    for _ in range(rounds):
+        rsp, t_send, t_recv = host.command(OP_TIMESYNC, bytes([0x01]))
+        if rsp[0] != 0 or len(rsp) < 12:
+            raise IOError('timesync command failed (status 0x%02x)' % rsp[0])
+        controller_us, frac = struct.unpack_from('<QH', rsp, 2)
+        controller_ns = controller_us * 1000 + frac * 1000 // 65536
+        rtt = t_recv - t_send
+        if best is None or rtt < best[1]:
+            best = (controller_ns - (t_send + t_recv) // 2, rtt, controller_ns)
+    return {'offset_ns': best[0], 'uncertainty_ns': best[1] // 2,
+            'controller_ns': best[2]}
+
+
+def transport_stats(host, reset):
+    rsp, _, _ = host.command(OP_TRANSPORT_STATS, bytes([0x01 if reset else 0x00]))
+    if rsp[0] != 0:
+        return None
+    return dict(zip(TRANSPORT_STATS_FIELDS,
+                    struct.unpack_from('<%dI' % len(TRANSPORT_STATS_FIELDS), rsp, 1)))
+
+
+def read_profile(host, point, reset):
+    rsp, _, _ = host.command(OP_READ_PROFILE, bytes([point, 0x01 if reset else 0x00]))
+    if rsp[0] != 0:
+        return None
+    _, hz, count, cmin, cmax, csum = PROF_HDR.unpack_from(rsp, 1)
+    hist = struct.unpack_from('<%dI' % PROF_HIST_BINS, rsp, 1 + PROF_HDR.size)
+    if not count:
+        return {'count': 0}
+    ns = 1e9 / hz
+    return {'count': count, 'min_ns': cmin * ns, 'mean_ns': csum / count * ns,
+            'max_ns': cmax * ns, 'hist': list(hist)}
+
+
+def percentiles(values):
+    if not values:
+        return None
+    values = sorted(values)
+    result = {'min': values[0], 'max': values[-1], 'mean': sum(values) / len(values)}
+    for p in PERCENTILES:
+        rank = max(0, min(len(values) - 1, int(len(values) * p / 100.0 + 0.5) - 1))
+        result['p%s' % p] = values[rank]
+    return result
+
+
+def parse_mix(text):
+    mix = []
+    for item in text.split(','):
+        kind, _, weight = item.partition(':')
+        if kind not in ('acl', 'iso', 'cmd'):
+            raise argparse.ArgumentTypeError('unknown packet kind %s' % kind)
+        mix.extend([kind] * int(weight or 1))
+    return mix
+
+
+def data_packet(kind, seq, length):
+    payload = PAYLOAD_HDR.pack(0, seq).ljust(length, bytes([seq & 0xff]))
+    if kind == 'acl':
+        return struct.pack('<BHH', H4_ACL, ACL_HANDLE, len(payload)) + payload
+    return struct.pack('<BHH', H4_ISO, ISO_HANDLE | (ISO_PB_SINGLE << 12),
+                       len(payload)) + payload
+
+
+def run(args):
+    port = H4Port(args.port, args.baud, args.rtscts)
+    host = Host(port)
+    mix = args.mix
+    loopback = args.mode in ('loopback', 'controller')
+    result = {'config': {k: v for k, v in vars(args).items() if k != 'func'}}
+
+    if args.reset:
+        host.command(OP_RESET)
+    transport_stats(host, reset=True)
+    if args.profile:
+        for point in range(len(PROF_POINTS)):
+            read_profile(host, point, reset=True)
+    rsp, _, _ = host.command(OP_TRANSPORT_BENCH, bytes([BENCH_MODES[args.mode]]))
+    if rsp[0] != 0:
+        raise IOError('benchmark mode not supported, build with overlay-bench.conf')
+    sync_start = timesync(host, args.sync_rounds)
+
+    inflight = {}
+    samples = {'acl': [], 'iso': [], 'cmd': []}
+    counts = {'h2c_packets': 0, 'h2c_bytes': 0, 'c2h_packets': 0, 'c2h_bytes': 0,
+              'lost': 0, 'unexpected': 0}
+    cmd_pending = [None]
+    first_send = [None]
+    last_recv = [None]
+
+    def on_sent(seq):
+        def cb(t):
+            if first_send[0] is None:
+                first_send[0] = t
+            if seq in inflight:
+                inflight[seq][1] = t
+        return cb
+
+    def on_packet(h4_type, packet, t):
+        counts['c2h_packets'] += 1
+        counts['c2h_bytes'] += len(packet)
+        last_recv[0] = t
+        if h4_type == H4_EVT:
+            rsp = Host._complete(packet, args.cmd_opcode)
+            if rsp is not None and cmd_pending[0] is not None:
+                entry = inflight.pop(cmd_pending[0], None)
+                if entry and entry[1] is not None:
+                    samples['cmd'].append((t - entry[1], None, None))
+                cmd_pending[0] = None
+            return
+        if len(packet) < 5 + PAYLOAD_HDR.size:
+            counts['unexpected'] += 1
+            return
+        controller_us, seq = PAYLOAD_HDR.unpack_from(packet, 5)
+        entry = inflight.pop(seq, None)
+        if not entry or entry[1] is None:
+            counts['unexpected'] += 1
+            return
+        samples[entry[0]].append((t - entry[1], controller_us * 1000, entry[1]))
+
+    host.on_packet = on_packet
+
+    seq = 0
+    start = time.monotonic()
+    while True:
+        elapsed = time.monotonic() - start
+        done = seq >= args.count if args.count else elapsed >= args.duration
+        if done and (not loopback or not inflight):
+            break
+        if done and elapsed > (args.duration or 0) + args.timeout + 60:
+            break
+
+        # Sink mode is paced by the port only, the data does not come back
+        while (not done and (not loopback or len(inflight) < args.window) and
+               len(port.tx) < 4096):
+            kind = mix[seq % len(mix)]
+            if kind == 'cmd':
+                if cmd_pending[0] is not None:
+                    kind = 'acl' if 'acl' in mix else 'iso' if 'iso' in mix else None
+                    if kind is None:
+                        break
+                else:
+                    cmd_pending[0] = seq
+            if kind == 'cmd':
+                packet = struct.pack('<BHB', H4_CMD, args.cmd_opcode, 0)
+            else:
+                packet = data_packet(kind, seq,
+                                     args.acl_len if kind == 'acl' else args.iso_len)
+            counts['h2c_packets'] += 1
+            counts['h2c_bytes'] += len(packet)
+            if loopback or kind == 'cmd':
+                inflight[seq] = [kind, None, time.monotonic()]
+            port.queue(packet, on_sent(seq))
+            seq += 1
+            done = seq >= args.count if args.count else False
+
+        for h4_type, packet, t in port.poll(0.01):
+            on_packet(h4_type, packet, t)
+
+        expired = [s for s, e in inflight.items()
+                   if time.monotonic() - e[2] > args.timeout]
+        for s in expired:
+            if inflight[s][0] == 'cmd':
+                cmd_pending[0] = None
+            del inflight[s]
+            counts['lost'] += 1
+
+    # The commands are queued behind the data, so their completion marks
+    # the time the last packet has been taken by the firmware.
+    fw_stats = transport_stats(host, reset=False)
+    end_ns = now_ns()
+    if args.profile:
+        result['profile'] = {name: read_profile(host, point, reset=False)
+                             for point, name in enumerate(PROF_POINTS)}
+    sync_end = timesync(host, args.sync_rounds)
+    host.command(OP_TRANSPORT_BENCH, bytes([BENCH_MODES['off']]))
+    port.close()
+
+    def host_time(controller_ns):
+        # Offset interpolated linearly over the run, for clock drift
+        span = sync_end['controller_ns'] - sync_start['controller_ns']
+        drift = sync_end['offset_ns'] - sync_start['offset_ns']
+        frac = (controller_ns - sync_start['controller_ns']) / span if span else 0
+        return controller_ns - (sync_start['offset_ns'] + drift * frac)
+
+    latency = {}
+    for kind, entries in samples.items():
+        if not entries:
+            continue
+        rtt = [e[0] / 1000.0 for e in entries]
+        stat = {'packets': len(entries), 'rtt_us': percentiles(rtt)}
+        if kind != 'cmd' and loopback:
+            h2c = [(host_time(e[1]) - e[2]) / 1000.0 for e in entries]
+            stat['h2c_us'] = percentiles(h2c)
+            stat['c2h_us'] = percentiles([r - d for r, d in zip(rtt, h2c)])
+        latency[kind] = stat
+
+    h2c_end = end_ns if not loopback else (last_recv[0] or end_ns)
+    h2c_s = max(1, h2c_end - (first_send[0] or h2c_end)) / 1e9
+    c2h_s = max(1, (last_recv[0] or end_ns) - (first_send[0] or end_ns)) / 1e9
+    result['throughput'] = {
+        'h2c': {'packets': counts['h2c_packets'], 'bytes': counts['h2c_bytes'],
+                'seconds': h2c_s, 'kbps': counts['h2c_bytes'] * 8 / h2c_s / 1000},
+        'c2h': {'packets': counts['c2h_packets'], 'bytes': counts['c2h_bytes'],
+                'seconds': c2h_s, 'kbps': counts['c2h_bytes'] * 8 / c2h_s / 1000},
+    }
+    result['latency'] = latency
+    result['drops'] = {'lost': counts['lost'], 'unexpected': counts['unexpected']}
+    if fw_stats:
+        result['drops'].update({k: fw_stats[k] for k in (
+            'h2c_alloc_failures', 'h2c_discarded', 'h2c_unknown_type',
+            'h2c_send_errors', 'c2h_evt_drops')})
+        result['firmware'] = fw_stats
+    result['timesync'] = {'start': sync_start, 'end': sync_end}
+
+    text = json.dumps(result, indent=2)
+    if args.out:
+        with open(args.out, 'w') as f:
+            f.write(text + '\n')
+    print(text)
+    return 0
+
+
+def profile(args):
+    port = H4Port(args.port, args.baud, args.rtscts)
+    host = Host(port)
+    result = {'config': {k: v for k, v in vars(args).items() if k != 'func'}}
+
+    for point in range(len(PROF_POINTS)):
+        if read_profile(host, point, reset=True) is None:
+            port.close()
+            print('profile not available, build with CONFIG_HCI_UART_PROF', file=sys.stderr)
+            return 1
+    for _ in range(args.count):
+        host.command(OP_TIMESYNC, bytes([0x01]))
+    result['profile'] = {name: read_profile(host, point, reset=False)
+                         for point, name in enumerate(PROF_POINTS)}
+    port.close()
+
+    text = json.dumps(result, indent=2)
+    if args.out:
+        with open(args.out, 'w') as f:
+            f.write(text + '\n')
+    print(text)
+    return 0
+
+
+def flatten(prefix, value, out):
+    if isinstance(value, dict):
+        for k, v in value.items():
+            flatten('%s.%s' % (prefix, k) if prefix else k, v, out)
+    elif isinstance(value, (int, float)) and not isinstance(value, bool):
+        out[prefix] = value
+    return out
+
+
+def compare(args):
+    results = []
+    for path in (args.before, args.after):
+        with open(path) as f:
+            results.append(json.load(f))
+    keys = ('throughput', 'latency', 'drops', 'profile')
+    before = flatten('', {k: results[0].get(k) for k in keys}, {})
+    after = flatten('', {k: results[1].get(k) for k in keys}, {})
+
+    print('%-32s %14s %14s %9s' % ('metric', 'before', 'after', 'change'))
+    for key in sorted(set(before) | set(after)):
+        b = before.get(key)
+        a = after.get(key)
+        change = ''
+        if b and a is not None:
+            change = '%+.1f%%' % ((a - b) * 100.0 / b)
+        print('%-32s %14s %14s %9s' % (key, '-' if b is None else '%.1f' % b,
+                                       '-' if a is None else '%.1f' % a, change))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    p = sub.add_parser('run', help='run a benchmark')
+    p.add_argument('--port', required=True, help='serial port or native_sim PTY')
+    p.add_argument('--baud', type=int, default=1000000)
+    p.add_argument('--rtscts', action='store_true', help='hardware flow control')
+    p.add_argument('--mode', choices=('loopback', 'sink', 'controller'), default='loopback',
+                   help='firmware returns or drops the data, or the controller returns it')
+    p.add_argument('--mix', type=parse_mix, default=parse_mix('acl:1'),
+                   help='weighted packet mix, e.g. acl:8,iso:2,cmd:1')
+    p.add_argument('--acl-len', type=int, default=251, help='ACL payload length')
+    p.add_argument('--iso-len', type=int, default=251, help='ISO payload length')
+    p.add_argument('--cmd-opcode', type=lambda x: int(x, 0), default=OP_READ_LOCAL_VERSION,
+                   help='command in the mix, answered by Command Complete')
+    p.add_argument('--count', type=int, default=0, help='packets to send')
+    p.add_argument('--duration', type=float, default=10.0, help='seconds, without --count')
+    p.add_argument('--window', type=int, default=4, help='packets in flight')
+    p.add_argument('--timeout', type=float, default=1.0,
+                   help='seconds after which a packet counts as lost')
+    p.add_argument('--sync-rounds', type=int, default=16)
+    p.add_argument('--reset', action='store_true', help='send HCI Reset first')
+    p.add_argument('--profile', action='store_true',
+                   help='read the cycle profile of the run (CONFIG_HCI_UART_PROF)')
+    p.add_argument('--out', help='write the JSON result to this file')
+    p.set_defaults(func=run)
+
+    p = sub.add_parser('profile', help='read the cycle profile after timesync commands')
+    p.add_argument('--port', required=True, help='serial port or native_sim PTY')
+    p.add_argument('--baud', type=int, default=1000000)
+    p.add_argument('--rtscts', action='store_true', help='hardware flow control')
+    p.add_argument('--count', type=int, default=1000, help='timesync commands to send')
+    p.add_argument('--out', help='write the JSON result to this file')
+    p.set_defaults(func=profile)
+
+    p = sub.add_parser('compare', help='compare two results')
+    p.add_argument('before')
+    p.add_argument('after')
+    p.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
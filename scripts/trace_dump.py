@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# Copyright (c) 2024 Nordic Semiconductor ASA
+#
+# SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+#
+"""Read and decode the binary packet trace of the HCI UART application.
+
+The firmware needs CONFIG_HCI_UART_TRACE. Recording is stopped while the
+ring is read, so the dump is a consistent snapshot, and restarted after.
+
+  trace_dump.py --port /dev/ttyACM0 --rtscts
+  trace_dump.py --port /dev/pts/3 --json > trace.json
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+from h4_bench import H4Port, Host, op
+
+OP_TRACE_READ = op(0x3f, 0x208)
+
+TRACE_READ_FLAGS_STOP = 0x01
+TRACE_READ_FLAGS_START = 0x02
+
+# Next, head, count, cycles per second, anchor cycles and controller time
+RESPONSE = struct.Struct('<IIBIIQ')
+RECORD = struct.Struct('<IIHHI')
+
+# Event ids, keep in sync with src/trace.h
+EVENTS = {
+    1: ('H4_READ', 'requested', 'read'),
+    2: ('H2C_PACKET', 'h4_type', 'len'),
+    3: ('H2C_DROP', 'reason', 'h4_type'),
+    4: ('BT_SEND', 'buf_type', 'err'),
+    5: ('C2H_QUEUE', 'buf_type', 'len'),
+    6: ('C2H_START', 'h4_type', 'len'),
+    7: ('C2H_SENT', None, None),
+    8: ('EVT_DROP', 'subevent', None),
+    9: ('RX_PAUSE', 'paused', None),
+    10: ('UART_SPURIOUS', None, None),
+    11: ('TIMESYNC', 'flags', 'status'),
+}
+
+H4_TYPES = {1: 'CMD', 2: 'ACL', 3: 'SCO', 4: 'EVT', 5: 'ISO'}
+# enum bt_buf_type of Zephyr as in nRF Connect SDK v2.8
+BUF_TYPES = {0: 'CMD', 1: 'EVT', 2: 'ACL_OUT', 3: 'ACL_IN', 4: 'ISO_OUT', 5: 'ISO_IN'}
+DROP_REASONS = {1: 'NO_BUF', 2: 'TOO_LONG', 3: 'UNKNOWN_TYPE'}
+
+
+def read_records(host):
+    """Return the records from the oldest one on, the number lost and the
+    time base (cycles per second, cycles, controller time in us).
+
+    The time base of the first response is used, it is taken after the
+    recording has been stopped, so it is later than all records.
+    """
+    records = []
+    anchor = None
+    index = 0
+    flags = TRACE_READ_FLAGS_STOP
+    while True:
+        rsp, _, _ = host.command(OP_TRACE_READ, struct.pack('<BI', flags, index))
+        if rsp[0] != 0:
+            raise IOError('trace read failed (status 0x%02x), '
+                          'build with CONFIG_HCI_UART_TRACE' % rsp[0])
+        flags = 0
+        index, head, count, hz, cycles, time_us = RESPONSE.unpack_from(rsp, 1)
+        if anchor is None:
+            anchor = (hz, cycles, time_us)
+        for i in range(count):
+            records.append(RECORD.unpack_from(rsp, 1 + RESPONSE.size + i * RECORD.size))
+        if index == head:
+            break
+    host.command(OP_TRACE_READ, struct.pack('<BI', TRACE_READ_FLAGS_START, head))
+
+    lost = 0
+    if records:
+        lost = records[-1][0] - records[0][0] + 1 - len(records)
+    return records, lost, anchor
+
+
+def decode_arg(name, value):
+    if name == 'h4_type':
+        return H4_TYPES.get(value, value)
+    if name == 'buf_type':
+        return BUF_TYPES.get(value, value)
+    if name == 'reason':
+        return DROP_REASONS.get(value, value)
+    if name == 'err':
+        return struct.unpack('<i', struct.pack('<I', value))[0]
+    return value
+
+
+def signed_delta(a, b):
+    return ((a - b + 0x80000000) & 0xffffffff) - 0x80000000
+
+
+def decode(records, anchor):
+    """Convert the 32-bit cycle counter of the records to controller time
+    and name events and arguments.
+
+    The cycle counter is unwrapped backwards from the anchor. The delta to
+    the next record is signed, a record written from an interrupt can be a
+    little older than the one before it.
+    """
+    hz, anchor_cycles, anchor_us = anchor
+    events = []
+    cycles = 0
+    prev = anchor_cycles
+    for seq, c, event, arg0, arg1 in reversed(records):
+        # Cycles relative to the anchor, 0 or negative
+        cycles += signed_delta(c, prev)
+        prev = c
+        name, name0, name1 = EVENTS.get(event, ('EVENT_%d' % event, 'arg0', 'arg1'))
+        entry = {'index': seq - 1, 'time_us': anchor_us + cycles * 1000000 // hz,
+                 'event': name}
+        if name0:
+            entry[name0] = decode_arg(name0, arg0)
+        if name1:
+            entry[name1] = decode_arg(name1, arg1)
+        events.append(entry)
+    events.reverse()
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('--port', required=True, help='serial port or native_sim PTY')
+    parser.add_argument('--baud', type=int, default=1000000)
+    parser.add_argument('--rtscts', action='store_true', help='hardware flow control')
+    parser.add_argument('--json', action='store_true', help='print JSON instead of text')
+    args = parser.parse_args()
+
+    port = H4Port(args.port, args.baud, args.rtscts)
+    try:
+        records, lost, anchor = read_records(Host(port))
+    finally:
+        port.close()
+    events = decode(records, anchor)
+
+    if args.json:
+        print(json.dumps({'lost': lost, 'events': events}, indent=2))
+        return 0
+
+    start = events[0]['time_us'] if events else 0
+    prev = start
+    for e in events:
+        args_text = ' '.join('%s=%s' % (k, v) for k, v in e.items()
+                             if k not in ('index', 'time_us', 'event'))
+        print('%10d %12d %+8d  %-14s %s' % (e['index'], e['time_us'] - start,
+                                            e['time_us'] - prev, e['event'], args_text))
+        prev = e['time_us']
+    if lost:
+        print('%d records skipped while being written' % lost, file=sys.stderr)
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -17,6 +17,36 @@
  */
 uint32_t audio_sync_timer_capture(void);
 
+/**
+ * @brief Capture a timestamp on the sync timer without truncating it to 32 bits.
+ *
+ * See @ref audio_sync_timer_capture().
+ *
+ * @retval The current timestamp of the audio sync timer in microseconds.
+ */
+uint64_t audio_sync_timer_capture_64(void);
+
+/**
+ * @brief Returns how often a capture had to be repeated.
+ *
+ * A capture is repeated once if an RTC tick happened during it, see
+ * @ref audio_sync_timer_capture_64().
+ *
+ * @retval The number of repeated captures since boot.
+ */
+uint32_t audio_sync_timer_recapture_count_get(void);
+
+/**
+ * @brief Returns how often the repeated capture did not complete either.
+ *
+ * The RTC CC[n] register was then not updated within the poll bound, and
+ * the time was read by the CPU instead, see
+ * @ref audio_sync_timer_capture_64().
+ *
+ * @retval The number of stale captures since boot.
+ */
+uint32_t audio_sync_timer_stale_capture_count_get(void);
+
 /**
  * @brief Returns the last captured value of the sync timer.
  *
@@ -5,6 +5,8 @@
  */
 
 #include "audio_sync_timer.h"
+#include "rtc_time.h"
+#include "controller_time.h"
 
 #include <zephyr/kernel.h>
 #include <zephyr/init.h>
@@ -33,7 +35,12 @@ static const nrfx_timer_t audio_sync_hf_timer_instance =
 #define AUDIO_SYNC_LF_TIMER_CURR_TIME_CAPTURE_CHANNEL           1
 #define AUDIO_SYNC_LF_TIMER_CURR_TIME_CAPTURE                   NRF_RTC_TASK_CAPTURE_1
 
+/* Upper bound for polling the CC[n] update, see audio_sync_timer_capture_once() */
+#define AUDIO_SYNC_CAPTURE_CC_POLL_MAX                          64
+
 static uint8_t dppi_channel_curr_time_capture;
+static uint32_t num_recaptures;
+static uint32_t num_stale_captures;
 
 static const nrfx_rtc_config_t rtc_cfg = NRFX_RTC_DEFAULT_CONFIG;
 
@@ -42,7 +49,10 @@ static const nrfx_rtc_t audio_sync_lf_timer_instance =
 
 static uint8_t dppi_channel_timer_sync_with_rtc;
 static uint8_t dppi_channel_rtc_start;
-static volatile uint32_t num_rtc_overflows;
+/* Counted by rtc_overflow_isr() or timestamp_from_rtc_and_timer_get(), with
+ * IRQs locked
+ */
+static uint32_t num_rtc_overflows;
 
 static nrfx_timer_config_t cfg = {.frequency = NRFX_MHZ_TO_HZ(1UL),
 				  .mode = NRF_TIMER_MODE_TIMER,
@@ -50,17 +60,35 @@ static nrfx_timer_config_t cfg = {.frequency = NRFX_MHZ_TO_HZ(1UL),
 				  .interrupt_priority = NRFX_TIMER_DEFAULT_CONFIG_IRQ_PRIORITY,
 				  .p_context = NULL};
 
-static uint32_t timestamp_from_rtc_and_timer_get(uint32_t ticks, uint32_t remainder_us)
+/* Called with IRQs locked, so num_rtc_overflows is stable. An overflow that
+ * the ISR has not counted yet is counted here from the pending OVRFLW event.
+ */
+static uint64_t timestamp_from_rtc_and_timer_get(uint32_t ticks, uint32_t remainder_us)
 {
-	const uint64_t rtc_ticks_in_femto_units = 30517578125UL;
-	const uint32_t rtc_overflow_time_us = 512000000UL;
+	const uint64_t rtc_overflow_time_us = 512000000UL;
+	bool overflow_pending = nrf_rtc_event_check(audio_sync_lf_timer_instance.p_reg,
+						    NRF_RTC_EVENT_OVERFLOW);
+	uint32_t overflows;
+
+	if (overflow_pending) {
+		nrf_rtc_event_clear(audio_sync_lf_timer_instance.p_reg, NRF_RTC_EVENT_OVERFLOW);
+	}
+	overflows = rtc_time_overflows_get(&num_rtc_overflows, ticks, overflow_pending);
 
-	return ((ticks * rtc_ticks_in_femto_units) / 1000000000UL) +
-		(num_rtc_overflows * rtc_overflow_time_us) +
+	return rtc_time_ticks_to_us(ticks) +
+		(overflows * rtc_overflow_time_us) +
 		remainder_us;
 }
 
 uint32_t audio_sync_timer_capture(void)
+{
+	return (uint32_t)audio_sync_timer_capture_64();
+}
+
+/* Returns false if the CC[n] register was not updated within the poll bound.
+ * The timestamp is then not valid.
+ */
+static bool audio_sync_timer_capture_once(uint64_t *timestamp_us, bool *tick_during_capture)
 {
 	/* Ensure that the follow product specification statement is handled:
 	 *
@@ -74,6 +102,10 @@ uint32_t audio_sync_timer_capture(void)
 	 * counter value.
 	 */
 	uint32_t tick_stale = nrf_rtc_counter_get(audio_sync_lf_timer_instance.p_reg);
+	uint32_t polls = 0;
+
+	/* Detect RTC ticks from here on, see audio_sync_timer_capture_64() */
+	nrf_rtc_event_clear(audio_sync_lf_timer_instance.p_reg, NRF_RTC_EVENT_TICK);
 
 	/* Set a stale value in the CC[n] register */
 	tick_stale--;
@@ -87,8 +119,10 @@ uint32_t audio_sync_timer_capture(void)
 	uint32_t tick = nrf_rtc_cc_get(audio_sync_lf_timer_instance.p_reg,
 				       AUDIO_SYNC_LF_TIMER_CURR_TIME_CAPTURE_CHANNEL);
 
-	/* If required, wait until CC[n] register is updated */
-	while (tick == tick_stale) {
+	/* If required, wait until CC[n] register is updated. 6 PCLK16M periods
+	 * are a few polls only, the bound keeps this finite in any case.
+	 */
+	while (tick == tick_stale && polls++ < AUDIO_SYNC_CAPTURE_CC_POLL_MAX) {
 		tick = nrf_rtc_cc_get(audio_sync_lf_timer_instance.p_reg,
 				      AUDIO_SYNC_LF_TIMER_CURR_TIME_CAPTURE_CHANNEL);
 	}
@@ -97,9 +131,123 @@ uint32_t audio_sync_timer_capture(void)
 	uint32_t remainder_us = nrf_timer_cc_get(NRF_TIMER1,
 						 AUDIO_SYNC_HF_TIMER_CURR_TIME_CAPTURE_CHANNEL);
 
+	if (tick == tick_stale) {
+		return false;
+	}
+
+	*tick_during_capture = nrf_rtc_event_check(audio_sync_lf_timer_instance.p_reg,
+						   NRF_RTC_EVENT_TICK);
+	*timestamp_us = timestamp_from_rtc_and_timer_get(tick, remainder_us);
+
+	return true;
+}
+
+/* Fallback if the capture by DPPI did not complete: read the RTC counter and
+ * capture the TIMER by the CPU, as on the nRF52 series, and try again if a
+ * tick happened in between.
+ */
+static uint64_t audio_sync_timer_capture_by_cpu(void)
+{
+	uint32_t tick;
+	uint32_t remainder_us;
+
+	do {
+		nrf_rtc_event_clear(audio_sync_lf_timer_instance.p_reg, NRF_RTC_EVENT_TICK);
+		tick = nrf_rtc_counter_get(audio_sync_lf_timer_instance.p_reg);
+		nrf_timer_task_trigger(NRF_TIMER1, AUDIO_SYNC_HF_TIMER_CURR_TIME_CAPTURE);
+		remainder_us = nrf_timer_cc_get(NRF_TIMER1,
+						AUDIO_SYNC_HF_TIMER_CURR_TIME_CAPTURE_CHANNEL);
+	} while (nrf_rtc_event_check(audio_sync_lf_timer_instance.p_reg, NRF_RTC_EVENT_TICK));
+
 	return timestamp_from_rtc_and_timer_get(tick, remainder_us);
 }
 
+uint64_t audio_sync_timer_capture_64(void)
+{
+	bool tick_during_capture = false;
+	uint64_t timestamp_us;
+	unsigned int key;
+	bool captured;
+
+	/* The TIMER is cleared by DPPI on every RTC tick. If a tick happens
+	 * during the capture, RTC and TIMER can be captured on different sides
+	 * of it and the time is off by one tick, see
+	 * https://devzone.nordicsemi.com/f/nordic-q-a/116907/bluetooth-netcore-time-capture-not-working-100-for-le-audio
+	 * The capture is then repeated, as is a capture whose CC[n] update was
+	 * not seen. Ticks are 30.5 us apart and IRQs are locked, so the second
+	 * capture cannot hit a tick again. If its CC[n] update is not seen
+	 * either, the time is read by the CPU.
+	 */
+	key = irq_lock();
+	captured = audio_sync_timer_capture_once(&timestamp_us, &tick_during_capture);
+	if (!captured || tick_during_capture) {
+		num_recaptures++;
+		captured = audio_sync_timer_capture_once(&timestamp_us, &tick_during_capture);
+	}
+	if (!captured) {
+		num_stale_captures++;
+		timestamp_us = audio_sync_timer_capture_by_cpu();
+	}
+	irq_unlock(key);
+
+	return timestamp_us;
+}
+
+uint32_t audio_sync_timer_recapture_count_get(void)
+{
+	return num_recaptures;
+}
+
+uint32_t audio_sync_timer_stale_capture_count_get(void)
+{
+	return num_stale_captures;
+}
+
+/* Controller time backend for the nRF5340 application core. The audio sync
+ * timer mirrors the controller clock, triggers are not supported.
+ */
+uint64_t controller_time_us_get(void)
+{
+	return audio_sync_timer_capture_64();
+}
+
+uint64_t controller_time_capture_us(void)
+{
+	return audio_sync_timer_capture_64();
+}
+
+uint64_t controller_time_trigger_set(uint64_t timestamp_us)
+{
+	ARG_UNUSED(timestamp_us);
+
+	return 0;
+}
+
+uint32_t controller_time_trigger_event_addr_get(void)
+{
+	return 0;
+}
+
+bool controller_time_trigger_supported(void)
+{
+	return false;
+}
+
+uint32_t controller_time_resolution_ns(void)
+{
+	return NSEC_PER_USEC;
+}
+
+uint32_t controller_time_recapture_count_get(void)
+{
+	return audio_sync_timer_recapture_count_get();
+}
+
+uint32_t controller_time_stale_capture_count_get(void)
+{
+	return audio_sync_timer_stale_capture_count_get();
+}
+
 
 //#include <stdio.h>
 //#include "led.h"
@@ -128,11 +276,26 @@ static void unused_timer_isr_handler(nrf_timer_event_t event_type, void *p_conte
 #endif
 }
 
-static void rtc_isr_handler(nrfx_rtc_int_type_t int_type)
+/* Replaces the nrfx handler, which clears the event before its callback
+ * counts it, see rtc_time_overflows_get()
+ */
+static void rtc_overflow_isr(const void *arg)
 {
-	if (int_type == NRFX_RTC_INT_OVERFLOW) {
+	unsigned int key;
+
+	ARG_UNUSED(arg);
+
+	key = irq_lock();
+	if (nrf_rtc_event_check(audio_sync_lf_timer_instance.p_reg, NRF_RTC_EVENT_OVERFLOW)) {
+		nrf_rtc_event_clear(audio_sync_lf_timer_instance.p_reg, NRF_RTC_EVENT_OVERFLOW);
 		num_rtc_overflows++;
 	}
+	irq_unlock(key);
+}
+
+static void unused_rtc_isr_handler(nrfx_rtc_int_type_t int_type)
+{
+	ARG_UNUSED(int_type);
 }
 
 /**
@@ -154,13 +317,13 @@ static int audio_sync_timer_init(void)
 		return -ENODEV;
 	}
 
-	ret = nrfx_rtc_init(&audio_sync_lf_timer_instance, &rtc_cfg, rtc_isr_handler);
+	ret = nrfx_rtc_init(&audio_sync_lf_timer_instance, &rtc_cfg, unused_rtc_isr_handler);
 	if (ret - NRFX_ERROR_BASE_NUM) {
 		LOG_ERR("nrfx rtc init error: %d", ret);
 		return -ENODEV;
 	}
 
-	IRQ_CONNECT(RTC0_IRQn, IRQ_PRIO_LOWEST, nrfx_rtc_0_irq_handler, NULL, 0);
+	IRQ_CONNECT(RTC0_IRQn, IRQ_PRIO_LOWEST, rtc_overflow_isr, NULL, 0);
 	nrfx_rtc_overflow_enable(&audio_sync_lf_timer_instance, true);
 
 	/* Initialize capturing of current timestamps */
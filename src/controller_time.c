@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file implements the backend independent part of controller time
+ */
+
+#include <zephyr/kernel.h>
+#include "controller_time.h"
+
+/* Enough captures to get a meaningful average even with a 32768 Hz
+ * system clock.
+ */
+#define CAPTURE_COST_ITERATIONS 1000
+
+uint32_t controller_time_capture_cost_ns(void)
+{
+	static uint32_t capture_cost_ns;
+
+	if (capture_cost_ns == 0) {
+		uint64_t start = k_cycle_get_64();
+
+		for (int i = 0; i < CAPTURE_COST_ITERATIONS; i++) {
+			(void)controller_time_capture_us();
+		}
+
+		capture_cost_ns = MAX(1, k_cyc_to_ns_ceil64(k_cycle_get_64() - start) /
+					 CAPTURE_COST_ITERATIONS);
+	}
+
+	return capture_cost_ns;
+}
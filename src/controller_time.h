@@ -5,6 +5,9 @@
  */
 
 // BK: based on / taken from ncs/nrf/samples/bluetooth/conn_time_sync/src/controller_time_sync.h
+// Extended to a common interface for all backends: controller_time_nrf52.c,
+// audio_sync_timer_rtc.c (nRF5340), controller_time_nrf54.c and
+// controller_time_native_sim.c
 
 #ifndef CONTROLLER_TIME_SYNC_H__
 #define CONTROLLER_TIME_SYNC_H__
@@ -21,11 +24,26 @@
  */
 uint64_t controller_time_us_get(void);
 
+/** @brief Capture the controller time for timestamping an event.
+ *
+ * Takes care of backend specific capture issues and returns the most
+ * accurate time available. Intended to be called with IRQs locked, right
+ * before or after the event.
+ *
+ * @return The captured controller time in microseconds.
+ */
+uint64_t controller_time_capture_us(void);
+
 /** @brief Set the controller to trigger a PPI event at the given timestamp.
+ *
+ * Only available if controller_time_trigger_supported() returns true.
  *
  * @param timestamp_us The timestamp where it will trigger.
+ *
+ * @return The timestamp where it will actually trigger, after rounding to the
+ *         resolution of the timers.
  */
-void controller_time_trigger_set(uint64_t timestamp_us);
+uint64_t controller_time_trigger_set(uint64_t timestamp_us);
 
 /** @brief Get the address of the event that will trigger.
  *
@@ -33,6 +51,44 @@ void controller_time_trigger_set(uint64_t timestamp_us);
  */
 uint32_t controller_time_trigger_event_addr_get(void);
 
+/** @brief Check if the backend can trigger a PPI event at a given time.
+ *
+ * @return true if controller_time_trigger_set() is supported.
+ */
+bool controller_time_trigger_supported(void);
+
+/** @brief Get the resolution of controller_time_capture_us().
+ *
+ * @return The resolution in nanoseconds.
+ */
+uint32_t controller_time_resolution_ns(void);
+
+/** @brief Get the duration of one controller_time_capture_us() call.
+ *
+ * Measured on first use as average over several captures.
+ *
+ * @return The duration in nanoseconds.
+ */
+uint32_t controller_time_capture_cost_ns(void);
+
+/** @brief Get how often a capture had to be corrected.
+ *
+ * Backends without corrections report 0.
+ *
+ * @return The number of captures since boot that were repeated because an
+ *         RTC tick happened during them.
+ */
+uint32_t controller_time_recapture_count_get(void);
+
+/** @brief Get how often the hardware capture did not complete.
+ *
+ * The time was then read by the CPU instead. Backends that do not capture
+ * by (D)PPI report 0.
+ *
+ * @return The number of stale hardware captures since boot.
+ */
+uint32_t controller_time_stale_capture_count_get(void);
+
 #endif
 
 /**
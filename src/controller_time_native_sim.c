@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file implements controller time for native_sim
+ *
+ * There is no controller clock to mirror, the system clock is used instead.
+ * Triggers are not supported.
+ */
+
+#include <zephyr/kernel.h>
+#include "controller_time.h"
+
+uint64_t controller_time_us_get(void)
+{
+	return k_cyc_to_us_floor64(k_cycle_get_64());
+}
+
+uint64_t controller_time_capture_us(void)
+{
+	return controller_time_us_get();
+}
+
+uint64_t controller_time_trigger_set(uint64_t timestamp_us)
+{
+	ARG_UNUSED(timestamp_us);
+
+	return 0;
+}
+
+uint32_t controller_time_trigger_event_addr_get(void)
+{
+	return 0;
+}
+
+bool controller_time_trigger_supported(void)
+{
+	return false;
+}
+
+uint32_t controller_time_resolution_ns(void)
+{
+	return MAX(NSEC_PER_USEC, DIV_ROUND_UP(NSEC_PER_SEC, sys_clock_hw_cycles_per_sec()));
+}
+
+uint32_t controller_time_recapture_count_get(void)
+{
+	return 0;
+}
+
+uint32_t controller_time_stale_capture_count_get(void)
+{
+	return 0;
+}
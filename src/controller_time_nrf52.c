@@ -8,13 +8,13 @@
  *
  * As the controller clock is not directly accessible, the controller
  * time is obtained using a mirrored RTC peripheral.
- * To achieve microsecond accurate toggling, a timer peripheral is also used.
+ * To achieve microsecond accurate toggling and time reads, a timer peripheral
+ * that is cleared on every RTC tick is also used.
  */
 
 // BK: taken from ncs/nrf/samples/bluetooth/conn_time_sync/src/controller_time_nrf52.c
 
 #include <zephyr/kernel.h>
-#include <zephyr/sys/barrier.h>
 #include <mpsl_clock.h>
 #include <nrfx_rtc.h>
 #include <nrfx_timer.h>
@@ -22,20 +22,42 @@
 #include <hal/nrf_egu.h>
 #include <soc.h>
 #include "controller_time.h"
+#include "rtc_time.h"
 
 static const nrfx_rtc_t app_rtc_instance = NRFX_RTC_INSTANCE(2);
 static const nrfx_timer_t app_timer_instance = NRFX_TIMER_INSTANCE(1);
 
+/* Channel 0 is used for the trigger compare */
+#define TIMER_CAPTURE_CHANNEL NRF_TIMER_CC_CHANNEL1
+
 static uint8_t ppi_chan_on_rtc_match;
-static volatile uint32_t num_rtc_overflows;
+/* Counted by rtc_overflow_isr() or controller_time_us_get(), with IRQs locked */
+static uint32_t num_rtc_overflows;
 
 static uint32_t offset_ticks_and_controller_to_app_rtc;
+/* Captures repeated for a tick, with IRQs locked */
+static uint32_t num_recaptures;
 
-static void rtc_isr_handler(nrfx_rtc_int_type_t int_type)
+/* Replaces the nrfx handler, which clears the event before its callback
+ * counts it, see rtc_time_overflows_get()
+ */
+static void rtc_overflow_isr(const void *arg)
 {
-	if (int_type == NRFX_RTC_INT_OVERFLOW) {
+	unsigned int key;
+
+	ARG_UNUSED(arg);
+
+	key = irq_lock();
+	if (nrf_rtc_event_check(app_rtc_instance.p_reg, NRF_RTC_EVENT_OVERFLOW)) {
+		nrf_rtc_event_clear(app_rtc_instance.p_reg, NRF_RTC_EVENT_OVERFLOW);
 		num_rtc_overflows++;
 	}
+	irq_unlock(key);
+}
+
+static void unused_rtc_isr_handler(nrfx_rtc_int_type_t int_type)
+{
+	ARG_UNUSED(int_type);
 }
 
 static void unused_timer_isr_handler(nrf_timer_event_t event_type, void *ctx)
@@ -58,7 +80,7 @@ static int rtc_config(void)
 
 	const nrfx_rtc_config_t rtc_cfg = NRFX_RTC_DEFAULT_CONFIG;
 
-	ret = nrfx_rtc_init(&app_rtc_instance, &rtc_cfg, rtc_isr_handler);
+	ret = nrfx_rtc_init(&app_rtc_instance, &rtc_cfg, unused_rtc_isr_handler);
 	if (ret != NRFX_SUCCESS) {
 		printk("Failed initializing RTC (ret: %d)\n", ret - NRFX_ERROR_BASE_NUM);
 		return -ENODEV;
@@ -66,10 +88,10 @@ static int rtc_config(void)
 
 #ifndef BT_CTLR_SDC_BSIM_BUILD
 	IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_RTC_INST_GET(2)), IRQ_PRIO_LOWEST,
-		    NRFX_RTC_INST_HANDLER_GET(2), NULL, 0);
+		    rtc_overflow_isr, NULL, 0);
 #else
 	IRQ_CONNECT(NRFX_IRQ_NUMBER_GET(NRF_RTC_INST_GET(2)), 0,
-		    (void *)NRFX_RTC_INST_HANDLER_GET(2), NULL, 0);
+		    (void *)rtc_overflow_isr, NULL, 0);
 #endif
 
 	nrfx_rtc_overflow_enable(&app_rtc_instance, true);
@@ -207,68 +229,71 @@ int controller_time_init(void)
 	return config_egu_trigger_on_rtc_and_timer_match();
 }
 
-static uint64_t rtc_ticks_to_us(uint32_t rtc_ticks)
-{
-	const uint64_t rtc_ticks_in_femto_units = 30517578125UL;
-
-	return (rtc_ticks * rtc_ticks_in_femto_units) / 1000000000UL;
-}
-
-static uint32_t us_to_rtc_ticks(uint32_t timestamp_us)
-{
-	const uint64_t rtc_ticks_in_femto_units = 30517578125UL;
-
-	return ((uint64_t)(timestamp_us) * 1000000000UL) / rtc_ticks_in_femto_units;
-}
-
 uint64_t controller_time_us_get(void)
 {
 	const uint64_t rtc_overflow_time_us = 512000000UL;
 
-	/* On the 52 series the RTC has to task to capture the current RTC value.
+	/* On the 52 series the RTC has no task to capture the current RTC value.
 	 * Therefore we cannot capture the TIMER and RTC value simultaneously.
-	 * Therefore we only use the RTC to read out the current time here.
-	 * This will result in an error of maximum one RTC tick.
+	 * Instead, the TIMER, which is cleared by PPI on every RTC tick, is
+	 * captured right after reading the RTC counter, with the TICK event
+	 * cleared before and checked after, as in audio_sync_timer_rtc.c. If a
+	 * tick happened in between, the counter and the TIMER may be from
+	 * different sides of it, e.g. the counter already incremented but the
+	 * TIMER not cleared yet, and we try again. A tick right before the event
+	 * is cleared is harmless: the PPI clears the TIMER within a 16 MHz cycle,
+	 * long before the counter read over the peripheral bus completes. This
+	 * gives microsecond resolution.
+	 *
+	 * IRQs are locked, so the overflow count cannot change in between. An
+	 * overflow that the ISR has not counted yet is counted here from the
+	 * pending OVRFLW event, so this works in any context, also from ISRs
+	 * that preempt the overflow ISR.
 	 */
 
 	uint32_t captured_rtc_overflows;
 	uint32_t captured_rtc_ticks;
+	uint32_t captured_timer_us;
+	bool overflow_pending;
+	unsigned int key;
 
-	while (true) {
-		captured_rtc_overflows = num_rtc_overflows;
-
-		/* Read out RTC ticks after reading number of overflows. */
-		barrier_isync_fence_full();
+	key = irq_lock();
 
+	for (;;) {
+		nrf_rtc_event_clear(app_rtc_instance.p_reg, NRF_RTC_EVENT_TICK);
 		captured_rtc_ticks = nrf_rtc_counter_get(app_rtc_instance.p_reg);
-
-		/* Read out number of overflows after reading number of RTC ticks  */
-		barrier_isync_fence_full();
-
-		if (captured_rtc_overflows == num_rtc_overflows) {
-			/* There were no new overflows after reading ticks.
-			 * That is, we can use the captured value.
-			 */
+		captured_timer_us = nrfx_timer_capture(&app_timer_instance, TIMER_CAPTURE_CHANNEL);
+		if (!nrf_rtc_event_check(app_rtc_instance.p_reg, NRF_RTC_EVENT_TICK)) {
 			break;
 		}
+		num_recaptures++;
+	}
+
+	overflow_pending = nrf_rtc_event_check(app_rtc_instance.p_reg, NRF_RTC_EVENT_OVERFLOW);
+	if (overflow_pending) {
+		nrf_rtc_event_clear(app_rtc_instance.p_reg, NRF_RTC_EVENT_OVERFLOW);
 	}
+	captured_rtc_overflows = rtc_time_overflows_get(&num_rtc_overflows, captured_rtc_ticks,
+							overflow_pending);
+
+	irq_unlock(key);
 
-	return rtc_ticks_to_us(captured_rtc_ticks) +
+	return rtc_time_ticks_to_us(captured_rtc_ticks) + captured_timer_us +
 	       (captured_rtc_overflows * rtc_overflow_time_us) +
-	       rtc_ticks_to_us(offset_ticks_and_controller_to_app_rtc);
+	       rtc_time_ticks_to_us(offset_ticks_and_controller_to_app_rtc);
 }
 
-void controller_time_trigger_set(uint64_t timestamp_us)
+uint64_t controller_time_trigger_set(uint64_t timestamp_us)
 {
 	uint64_t timestamp_without_rtc_offset =
-		timestamp_us - rtc_ticks_to_us(offset_ticks_and_controller_to_app_rtc);
+		timestamp_us - rtc_time_ticks_to_us(offset_ticks_and_controller_to_app_rtc);
 
 	uint32_t num_overflows = timestamp_without_rtc_offset / 512000000UL;
 	uint64_t overflow_time_us = num_overflows * 512000000UL;
 
 	uint32_t rtc_remainder_time_us = timestamp_without_rtc_offset - overflow_time_us;
-	uint32_t rtc_val = us_to_rtc_ticks(rtc_remainder_time_us);
-	uint8_t timer_val =	timestamp_without_rtc_offset - rtc_ticks_to_us(rtc_val);
+	uint32_t rtc_val = rtc_time_us_to_ticks(rtc_remainder_time_us);
+	uint8_t timer_val =	timestamp_without_rtc_offset - rtc_time_ticks_to_us(rtc_val);
 
 	/* Ensure the timer value lies between 1 and 30 so that it will
 	 * always be between two RTC ticks.
@@ -282,6 +307,9 @@ void controller_time_trigger_set(uint64_t timestamp_us)
 
 	nrfx_timer_compare(&app_timer_instance, 0, timer_val, false);
 	nrfx_gppi_channels_enable(BIT(ppi_chan_on_rtc_match));
+
+	return overflow_time_us + rtc_time_ticks_to_us(rtc_val) + timer_val +
+	       rtc_time_ticks_to_us(offset_ticks_and_controller_to_app_rtc);
 }
 
 uint32_t controller_time_trigger_event_addr_get(void)
@@ -289,4 +317,30 @@ uint32_t controller_time_trigger_event_addr_get(void)
 	return nrf_egu_event_address_get(NRF_EGU0, NRF_EGU_EVENT_TRIGGERED0);
 }
 
+uint64_t controller_time_capture_us(void)
+{
+	return controller_time_us_get();
+}
+
+bool controller_time_trigger_supported(void)
+{
+	return true;
+}
+
+uint32_t controller_time_resolution_ns(void)
+{
+	return NSEC_PER_USEC;
+}
+
+uint32_t controller_time_recapture_count_get(void)
+{
+	return num_recaptures;
+}
+
+/* The TIMER is captured by the CPU, there is no capture to complete */
+uint32_t controller_time_stale_capture_count_get(void)
+{
+	return 0;
+}
+
 SYS_INIT(controller_time_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
@@ -45,7 +45,7 @@ uint64_t controller_time_us_get(void)
 	return current_time_us;
 }
 
-void controller_time_trigger_set(uint64_t timestamp_us)
+uint64_t controller_time_trigger_set(uint64_t timestamp_us)
 {
 	int ret;
 
@@ -57,6 +57,9 @@ void controller_time_trigger_set(uint64_t timestamp_us)
 	if (ret != NRFX_SUCCESS) {
 		printk("Failed setting CC (ret: %d)\n", ret - NRFX_ERROR_BASE_NUM);
 	}
+
+	/* The GRTC counts in microseconds */
+	return timestamp_us;
 }
 
 uint32_t controller_time_trigger_event_addr_get(void)
@@ -65,4 +68,30 @@ uint32_t controller_time_trigger_event_addr_get(void)
 					  nrf_grtc_sys_counter_compare_event_get(grtc_channel));
 }
 
+uint64_t controller_time_capture_us(void)
+{
+	return controller_time_us_get();
+}
+
+bool controller_time_trigger_supported(void)
+{
+	return true;
+}
+
+uint32_t controller_time_resolution_ns(void)
+{
+	return NSEC_PER_USEC;
+}
+
+/* The GRTC is read in one access, captures need no correction */
+uint32_t controller_time_recapture_count_get(void)
+{
+	return 0;
+}
+
+uint32_t controller_time_stale_capture_count_get(void)
+{
+	return 0;
+}
+
 SYS_INIT(controller_time_init, POST_KERNEL, CONFIG_KERNEL_INIT_PRIORITY_DEFAULT);
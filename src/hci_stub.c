@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file implements a stub controller for native_sim
+ *
+ * There is no radio to run a link layer on. HCI Reset succeeds and all other
+ * commands the vendor extensions do not handle are answered as unknown. ACL
+ * and ISO data is looped back to the host, with a Number Of Completed
+ * Packets event for each ACL packet, so that both directions of the H4
+ * pipeline can be exercised.
+ */
+
+#define DT_DRV_COMPAT bt_hci_stub
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/drivers/bluetooth.h>
+#include <zephyr/bluetooth/hci.h>
+#include <zephyr/bluetooth/buf.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_REGISTER(hci_stub, LOG_LEVEL_INF);
+
+struct hci_stub_data {
+	bt_hci_recv_t recv;
+};
+
+static void hci_stub_cmd(const struct device *dev, struct net_buf *buf)
+{
+	struct hci_stub_data *data = dev->data;
+	struct bt_hci_cmd_hdr *hdr;
+	struct net_buf *rsp;
+	uint16_t opcode;
+	uint8_t status;
+
+	if (buf->len < sizeof(*hdr)) {
+		LOG_ERR("Command too short");
+		return;
+	}
+
+	hdr = net_buf_pull_mem(buf, sizeof(*hdr));
+	opcode = sys_le16_to_cpu(hdr->opcode);
+	status = opcode == BT_HCI_OP_RESET ? BT_HCI_ERR_SUCCESS : BT_HCI_ERR_UNKNOWN_CMD;
+
+	rsp = bt_hci_cmd_complete_create(opcode, sizeof(status));
+	net_buf_add_u8(rsp, status);
+	data->recv(dev, rsp);
+}
+
+static void hci_stub_num_completed(const struct device *dev, uint16_t handle)
+{
+	struct hci_stub_data *data = dev->data;
+	struct bt_hci_evt_num_completed_packets *ep;
+	struct bt_hci_evt_hdr *hdr;
+	struct net_buf *evt;
+
+	evt = bt_buf_get_evt(BT_HCI_EVT_NUM_COMPLETED_PACKETS, false, K_FOREVER);
+	hdr = net_buf_add(evt, sizeof(*hdr));
+	hdr->evt = BT_HCI_EVT_NUM_COMPLETED_PACKETS;
+	hdr->len = sizeof(*ep) + sizeof(ep->h[0]);
+
+	ep = net_buf_add(evt, sizeof(*ep) + sizeof(ep->h[0]));
+	ep->num_handles = 1;
+	ep->h[0].handle = sys_cpu_to_le16(handle);
+	ep->h[0].count = sys_cpu_to_le16(1);
+
+	data->recv(dev, evt);
+}
+
+static void hci_stub_loopback(const struct device *dev, struct net_buf *buf,
+			      enum bt_buf_type type)
+{
+	struct hci_stub_data *data = dev->data;
+	struct net_buf *rx;
+
+	rx = bt_buf_get_rx(type, K_FOREVER);
+	if (buf->len > net_buf_tailroom(rx)) {
+		LOG_ERR("Loopback packet too long (%u)", buf->len);
+		net_buf_unref(rx);
+		return;
+	}
+
+	net_buf_add_mem(rx, buf->data, buf->len);
+	data->recv(dev, rx);
+}
+
+static int hci_stub_open(const struct device *dev, bt_hci_recv_t recv)
+{
+	struct hci_stub_data *data = dev->data;
+
+	data->recv = recv;
+
+	return 0;
+}
+
+static int hci_stub_send(const struct device *dev, struct net_buf *buf)
+{
+	uint16_t handle;
+
+	switch (bt_buf_get_type(buf)) {
+	case BT_BUF_CMD:
+		hci_stub_cmd(dev, buf);
+		break;
+	case BT_BUF_ACL_OUT:
+		if (buf->len < sizeof(struct bt_hci_acl_hdr)) {
+			LOG_ERR("ACL packet too short");
+			break;
+		}
+		handle = bt_acl_handle(sys_get_le16(buf->data));
+		hci_stub_loopback(dev, buf, BT_BUF_ACL_IN);
+		hci_stub_num_completed(dev, handle);
+		break;
+	case BT_BUF_ISO_OUT:
+		hci_stub_loopback(dev, buf, BT_BUF_ISO_IN);
+		break;
+	default:
+		LOG_ERR("Unknown packet type %u", bt_buf_get_type(buf));
+		return -EINVAL;
+	}
+
+	net_buf_unref(buf);
+
+	return 0;
+}
+
+static const struct bt_hci_driver_api hci_stub_api = {
+	.open = hci_stub_open,
+	.send = hci_stub_send,
+};
+
+#define HCI_STUB_DEVICE_INIT(inst)                                                                 \
+	static struct hci_stub_data hci_stub_data_##inst;                                          \
+	DEVICE_DT_INST_DEFINE(inst, NULL, NULL, &hci_stub_data_##inst, NULL, POST_KERNEL,          \
+			      CONFIG_KERNEL_INIT_PRIORITY_DEVICE, &hci_stub_api)
+
+DT_INST_FOREACH_STATUS_OKAY(HCI_STUB_DEVICE_INIT)
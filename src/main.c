@@ -15,6 +15,7 @@
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/logging/log.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/barrier.h>
 
 #include <zephyr/device.h>
 #include <zephyr/init.h>
@@ -31,12 +32,19 @@
 #include <zephyr/bluetooth/buf.h>
 #include <zephyr/bluetooth/hci_raw.h>
 
-// nRF5340 - from ncs/nrf/nrf5340_audio example
-#include "audio_sync_timer.h"
-
-// nRF54L15 - from ncs/nrf/samples/bluetooth/conn_time_sync
+// Controller time, see controller_time.h for the backends
 #include "controller_time.h"
 
+#include "timesync_pulse.h"
+
+#include "uart_timestamp.h"
+
+#include "timesync_model.h"
+
+#include "prof.h"
+
+#include "trace.h"
+
 #define LOG_MODULE_NAME hci_uart
 LOG_MODULE_REGISTER(LOG_MODULE_NAME);
 
@@ -46,9 +54,398 @@ static K_THREAD_STACK_DEFINE(tx_thread_stack, CONFIG_BT_HCI_TX_STACK_SIZE);
 static struct k_thread tx_thread_data;
 static K_FIFO_DEFINE(tx_queue);
 
+/* Vendor command opcodes, OCF with OGF 0x3f */
+#define  HCI_CMD_ISO_TIMESYNC	(0x200)
+#define  HCI_CMD_ISO_TIMESYNC_SCHEDULE	(0x201)
+#define  HCI_CMD_ISO_TIMESYNC_TRAIN	(0x202)
+#define  HCI_CMD_ISO_TIMESYNC_MODEL	(0x203)
+#define  HCI_CMD_ISO_SDU_REPORT		(0x204)
+#define  HCI_CMD_TRANSPORT_STATS	(0x205)
+#define  HCI_CMD_TRANSPORT_BENCH	(0x206)
+#define  HCI_CMD_PROFILE		(0x207)
+#define  HCI_CMD_TRACE_READ	(0x208)
+
+/* Vendor event subevent codes */
+#define  HCI_EVT_VS_TIMESYNC_EDGE	(0x01)
+#define  HCI_EVT_VS_TIMESYNC_TX		(0x02)
+#define  HCI_EVT_VS_ISO_SDU		(0x03)
+
+#if defined(CONFIG_HCI_UART_STATS)
+/* Packets put into and taken from a queue, and the highest depth. Packets
+ * may be put from several contexts, but are taken by one consumer only,
+ * which also tracks the maximum: the depth only decreases by the consumer,
+ * so each peak is seen when the next packet is taken.
+ */
+struct h4_queue_stats {
+	atomic_t puts;
+	uint32_t gets;
+	uint32_t depth_max;
+};
+
+/* Transport statistics, read by HCI_CMD_TRANSPORT_STATS. Apart from the
+ * queue puts, every counter has a single writer, the UART interrupt or the
+ * TX engine, so no locking is needed. Counters wrap around.
+ */
+static struct {
+	/* Host to controller */
+	struct {
+		uint32_t bytes;
+		uint32_t packets;
+		/* bt_buf_get_tx() failed, packet dropped or receiving paused */
+		uint32_t alloc_failures;
+		/* Packet too long for the buffer */
+		uint32_t discarded;
+		uint32_t unknown_type;
+		/* Written by the TX thread */
+		uint32_t send_errors;
+		/* tx_queue */
+		struct h4_queue_stats queue;
+	} h2c;
+	/* Controller to host */
+	struct {
+		uint32_t bytes;
+		uint32_t packets;
+		/* Vendor reports dropped for lack of an event buffer */
+		atomic_t evt_drops;
+		/* Queue of the TX engine */
+		struct h4_queue_stats queue;
+	} c2h;
+} h4_stats;
+
+#define H4_STATS_ADD(field, n) (h4_stats.field += (n))
+#define H4_STATS_ATOMIC_INC(field) atomic_inc(&h4_stats.field)
+
+static void h4_stats_queue_put(struct h4_queue_stats *stats)
+{
+	atomic_inc(&stats->puts);
+}
+
+/* Called by the consumer, after the packet has been taken */
+static void h4_stats_queue_get(struct h4_queue_stats *stats)
+{
+	uint32_t depth = (uint32_t)atomic_get(&stats->puts) - stats->gets;
+
+	stats->gets++;
+	if (depth > stats->depth_max) {
+		stats->depth_max = depth;
+	}
+}
+
+static uint32_t h4_stats_queue_depth(const struct h4_queue_stats *stats)
+{
+	return (uint32_t)atomic_get(&stats->puts) - stats->gets;
+}
+#else
+#define H4_STATS_ADD(field, n)
+#define H4_STATS_ATOMIC_INC(field)
+#define h4_stats_queue_put(stats)
+#define h4_stats_queue_get(stats)
+#endif /* CONFIG_HCI_UART_STATS */
+
+#define H4_STATS_INC(field) H4_STATS_ADD(field, 1)
+
 /* RX in terms of bluetooth communication */
+#if defined(CONFIG_HCI_UART_TX_PRIO)
+/* Host bound traffic classes, in order of priority. Within a class, packets
+ * keep their order, so only the classes below may overtake other traffic:
+ * the timesync response, whose latency is measured, and advertising reports,
+ * which no other packet depends on.
+ */
+enum {
+	TX_CLASS_TIMESYNC,	/* Command Complete of the timesync command */
+	TX_CLASS_DEFAULT,	/* ISO and ACL data and all other events */
+	TX_CLASS_ADV_REPORT,	/* LE (Extended/Directed) Advertising Reports */
+	TX_CLASS_COUNT,
+};
+
+/* Enqueue timestamps per class, in the order of the queue. A class can hold
+ * every buffer of the RX pool, plus the TX buffers of looped back data.
+ */
+#if defined(CONFIG_HCI_UART_BENCH) && defined(CONFIG_BT_ISO)
+#define TX_CLASS_TS_COUNT \
+	(BT_BUF_RX_COUNT + CONFIG_BT_BUF_ACL_TX_COUNT + CONFIG_BT_ISO_TX_BUF_COUNT)
+#elif defined(CONFIG_HCI_UART_BENCH)
+#define TX_CLASS_TS_COUNT (BT_BUF_RX_COUNT + CONFIG_BT_BUF_ACL_TX_COUNT)
+#else
+#define TX_CLASS_TS_COUNT BT_BUF_RX_COUNT
+#endif
+
+/* Queueing delay from h4_send() until a packet is taken for transmission. */
+struct h4_tx_class_stats {
+	uint32_t packets;
+	uint32_t delay_max_us;
+	uint64_t delay_sum_us;
+};
+
+static struct {
+	struct k_fifo queue;
+	uint32_t ts[TX_CLASS_TS_COUNT];
+	uint16_t put;
+	uint16_t get;
+	struct h4_tx_class_stats stats;
+} tx_class[TX_CLASS_COUNT];
+
+/* Packets taken from higher classes while a lower class was waiting */
+static uint8_t tx_class_burst;
+
+static uint8_t h4_tx_class_get(struct net_buf *buf)
+{
+	/* Event code follows the H:4 packet type if present */
+	const size_t evt_offset = IS_ENABLED(CONFIG_BT_HCI_RAW_H4) ? 1 : 0;
+	const uint8_t *evt = &buf->data[evt_offset];
+
+	if (bt_buf_get_type(buf) != BT_BUF_EVT ||
+	    buf->len < evt_offset + sizeof(struct bt_hci_evt_hdr) + 3) {
+		return TX_CLASS_DEFAULT;
+	}
+
+	switch (evt[0]) {
+	case BT_HCI_EVT_CMD_COMPLETE:
+		/* Number of allowed commands, then the opcode */
+		if (sys_get_le16(&evt[3]) == BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC)) {
+			return TX_CLASS_TIMESYNC;
+		}
+		break;
+	case BT_HCI_EVT_LE_META_EVENT:
+		switch (evt[2]) {
+		case BT_HCI_EVT_LE_ADVERTISING_REPORT:
+		case BT_HCI_EVT_LE_DIRECT_ADV_REPORT:
+		case BT_HCI_EVT_LE_EXT_ADVERTISING_REPORT:
+			return TX_CLASS_ADV_REPORT;
+		default:
+			break;
+		}
+		break;
+	default:
+		break;
+	}
+
+	return TX_CLASS_DEFAULT;
+}
+
+static void h4_tx_queue_put(struct net_buf *buf)
+{
+	uint8_t class = h4_tx_class_get(buf);
+	unsigned int key;
+
+	/* Timestamp and queue position have to match, h4_send() is called
+	 * from several threads.
+	 */
+	key = irq_lock();
+	tx_class[class].ts[tx_class[class].put] = k_cycle_get_32();
+	if (++tx_class[class].put == TX_CLASS_TS_COUNT) {
+		tx_class[class].put = 0;
+	}
+	k_fifo_put(&tx_class[class].queue, buf);
+	irq_unlock(key);
+}
+
+/* Take the next packet by strict priority. If CONFIG_HCI_UART_TX_PRIO_MAX_BURST
+ * is set, a waiting lower class gets one packet after that many packets from
+ * higher classes.
+ */
+static struct net_buf *h4_tx_queue_get(void)
+{
+	struct net_buf *buf;
+	uint8_t class;
+	uint8_t lower;
+	uint32_t delay_us;
+
+	for (class = 0; class < TX_CLASS_COUNT; class++) {
+		if (!k_fifo_is_empty(&tx_class[class].queue)) {
+			break;
+		}
+	}
+
+	if (class == TX_CLASS_COUNT) {
+		return NULL;
+	}
+
+	for (lower = class + 1; lower < TX_CLASS_COUNT; lower++) {
+		if (!k_fifo_is_empty(&tx_class[lower].queue)) {
+			break;
+		}
+	}
+
+	if (lower == TX_CLASS_COUNT) {
+		tx_class_burst = 0;
+	} else if (CONFIG_HCI_UART_TX_PRIO_MAX_BURST &&
+		   tx_class_burst >= CONFIG_HCI_UART_TX_PRIO_MAX_BURST) {
+		tx_class_burst = 0;
+		class = lower;
+	} else {
+		tx_class_burst++;
+	}
+
+	buf = k_fifo_get(&tx_class[class].queue, K_NO_WAIT);
+	if (!buf) {
+		return NULL;
+	}
+
+	delay_us = k_cyc_to_us_floor32(k_cycle_get_32() - tx_class[class].ts[tx_class[class].get]);
+	if (++tx_class[class].get == TX_CLASS_TS_COUNT) {
+		tx_class[class].get = 0;
+	}
+	tx_class[class].stats.packets++;
+	tx_class[class].stats.delay_sum_us += delay_us;
+	tx_class[class].stats.delay_max_us = MAX(tx_class[class].stats.delay_max_us, delay_us);
+
+	return buf;
+}
+
+static bool h4_tx_queue_is_empty(void)
+{
+	for (int i = 0; i < TX_CLASS_COUNT; i++) {
+		if (!k_fifo_is_empty(&tx_class[i].queue)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void h4_tx_queue_init(void)
+{
+	for (int i = 0; i < TX_CLASS_COUNT; i++) {
+		k_fifo_init(&tx_class[i].queue);
+	}
+}
+#else
 static K_FIFO_DEFINE(uart_tx_queue);
 
+static void h4_tx_queue_put(struct net_buf *buf)
+{
+	k_fifo_put(&uart_tx_queue, buf);
+}
+
+static struct net_buf *h4_tx_queue_get(void)
+{
+	return k_fifo_get(&uart_tx_queue, K_NO_WAIT);
+}
+
+static bool h4_tx_queue_is_empty(void)
+{
+	return k_fifo_is_empty(&uart_tx_queue);
+}
+
+static void h4_tx_queue_init(void)
+{
+}
+#endif /* CONFIG_HCI_UART_TX_PRIO */
+
+static void h4_tx_enqueue(struct net_buf *buf)
+{
+	h4_stats_queue_put(&h4_stats.c2h.queue);
+	h4_tx_queue_put(buf);
+}
+
+#if defined(CONFIG_HCI_UART_TX_DIRECT)
+/* incoming events and data from the controller, taken over by the TX engine
+ * without a hop through main()
+ */
+static K_FIFO_DEFINE(rx_queue);
+
+/* Given whenever the TX engine ran out of packets */
+static K_SEM_DEFINE(tx_idle_sem, 0, 1);
+#endif
+
+#if defined(CONFIG_HCI_UART_ISO_SDU_REPORT)
+static void iso_sdu_report(struct net_buf *buf);
+#else
+static inline void iso_sdu_report(struct net_buf *buf) {}
+#endif
+
+#if defined(CONFIG_HCI_UART_TX_TIMESTAMP)
+/* Poll interval and give-up time for the capture of a timesync response,
+ * which may still wait behind a staged transfer when it is armed.
+ */
+#define TX_TS_REPORT_POLL_US		100
+#define TX_TS_REPORT_TIMEOUT_MS		100
+
+/* Time the timesync response started on the UART, see uart_timestamp.h. The
+ * TX engine counts the bytes it hands to the UART. When it takes the
+ * response from the queue, the first byte is armed and tx_ts_report_work
+ * polls for the capture.
+ */
+static void tx_ts_report_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(tx_ts_report_work, tx_ts_report_handler);
+
+static struct {
+	uint32_t bytes;
+	/* Response to timestamp, until the TX engine took it */
+	struct net_buf *buf;
+	int64_t deadline;
+} tx_ts;
+
+static void tx_ts_consumed(int32_t len)
+{
+	tx_ts.bytes += len;
+}
+
+static void tx_ts_packet_start(struct net_buf *buf)
+{
+	if (buf != tx_ts.buf) {
+		return;
+	}
+
+	tx_ts.buf = NULL;
+	if (uart_timestamp_arm(UART_TIMESTAMP_TX, tx_ts.bytes + 1)) {
+		tx_ts.deadline = k_uptime_get() + TX_TS_REPORT_TIMEOUT_MS;
+		k_work_schedule(&tx_ts_report_work, K_USEC(TX_TS_REPORT_POLL_US));
+	}
+}
+#else
+static inline void tx_ts_consumed(int32_t len) {}
+static inline void tx_ts_packet_start(struct net_buf *buf) {}
+#endif /* CONFIG_HCI_UART_TX_TIMESTAMP */
+
+/* Bytes handed to the UART, negative for staged bytes that could not be sent */
+static void h4_tx_consumed(int32_t len)
+{
+	H4_STATS_ADD(c2h.bytes, len);
+	tx_ts_consumed(len);
+}
+
+static struct net_buf *h4_tx_dequeue(void)
+{
+	struct net_buf *buf;
+
+#if defined(CONFIG_HCI_UART_TX_DIRECT)
+	while ((buf = k_fifo_get(&rx_queue, K_NO_WAIT)) != NULL) {
+		iso_sdu_report(buf);
+		h4_tx_enqueue(buf);
+	}
+#endif
+
+	buf = h4_tx_queue_get();
+	if (buf) {
+		h4_stats_queue_get(&h4_stats.c2h.queue);
+		H4_STATS_INC(c2h.packets);
+		TRACE(C2H_START, buf->data[0], buf->len);
+		tx_ts_packet_start(buf);
+	}
+
+	return buf;
+}
+
+static bool h4_tx_queue_empty(void)
+{
+#if defined(CONFIG_HCI_UART_TX_DIRECT)
+	if (!k_fifo_is_empty(&rx_queue)) {
+		return false;
+	}
+#endif
+
+	return h4_tx_queue_is_empty();
+}
+
+static void h4_tx_idle(void)
+{
+#if defined(CONFIG_HCI_UART_TX_DIRECT)
+	k_sem_give(&tx_idle_sem);
+#endif
+}
+
 #define H4_CMD 0x01
 #define H4_ACL 0x02
 #define H4_SCO 0x03
@@ -60,6 +457,7 @@ static K_FIFO_DEFINE(uart_tx_queue);
 #define ST_HDR 1	/* Receiving packet header. */
 #define ST_PAYLOAD 2	/* Receiving packet payload. */
 #define ST_DISCARD 3	/* Dropping packet. */
+#define ST_WAIT_BUF 4	/* Receiving paused until a buffer is available. */
 
 /* Length of a discard/flush buffer.
  * This is sized to align with a BLE HCI packet:
@@ -70,14 +468,20 @@ static K_FIFO_DEFINE(uart_tx_queue);
  */
 #define H4_DISCARD_LEN 33
 
+static void h4_rx_consumed(size_t len);
+
+#if !defined(CONFIG_HCI_UART_ASYNC_RX)
 static int h4_read(const struct device *uart, uint8_t *buf, size_t len)
 {
 	int rx = uart_fifo_read(uart, buf, len);
 
-	LOG_DBG("read %d req %d", rx, len);
+	h4_rx_consumed(rx);
+
+	TRACE(H4_READ, len, rx);
 
 	return rx;
 }
+#endif
 
 static bool valid_type(uint8_t type)
 {
@@ -117,333 +521,1943 @@ static int hdr_len(uint8_t type)
 	}
 }
 
-static void rx_isr(void)
-{
-	static struct net_buf *buf;
-	static int remaining;
-	static uint8_t state;
-	static uint8_t type;
-	static uint8_t hdr_buf[MAX(sizeof(struct bt_hci_cmd_hdr),
+/* H4 receive state, shared by the interrupt driven and the async parser. */
+static struct {
+	struct net_buf *buf;
+	int remaining;
+	uint8_t state;
+	uint8_t type;
+	uint8_t hdr[MAX(sizeof(struct bt_hci_cmd_hdr),
 			sizeof(struct bt_hci_acl_hdr))];
-	int read;
+} rx;
+
+#if defined(CONFIG_HCI_UART_RX_TIMESTAMP)
+/* Arrival time of the H4 packets, see uart_timestamp.h. The parser counts
+ * the bytes it consumed, which matches the number of RXDRDY events. Once the
+ * length of a packet is known, the first byte of the next packet is armed.
+ * Arrival times of commands are queued in order and picked up by tx_send()
+ * before the command is passed to the controller. There are never more
+ * commands in flight than command buffers.
+ */
+struct rx_timestamp {
+	uint32_t ticks;
+	bool valid;
+};
+
+static struct {
+	uint32_t bytes;
+	uint32_t armed;
+	struct rx_timestamp packet;
+	struct rx_timestamp cmd[CONFIG_BT_BUF_CMD_TX_COUNT];
+	uint32_t cmd_put;
+	uint32_t cmd_get;
+	/* Command currently processed by the controller */
+	struct rx_timestamp current;
+} rx_ts;
+
+static void rx_ts_consumed(size_t len)
+{
+	rx_ts.bytes += len;
+}
 
-	do {
-		switch (state) {
-		case ST_IDLE:
-			/* Get packet type */
-			read = h4_read(hci_uart_dev, &type, sizeof(type));
-			/* since we read in loop until no data is in the fifo,
-			 * it is possible that read = 0.
-			 */
-			if (read) {
-				if (valid_type(type)) {
-					/* Get expected header size and switch
-					 * to receiving header.
-					 */
-					remaining = hdr_len(type);
-					state = ST_HDR;
-				} else {
-					LOG_WRN("Unknown header %d", type);
-				}
+/* Called after the type byte has been consumed */
+static void rx_ts_packet_start(void)
+{
+	rx_ts.packet.valid = rx_ts.armed == rx_ts.bytes &&
+			     uart_timestamp_get(UART_TIMESTAMP_RX, &rx_ts.packet.ticks);
+}
+
+/* Called once the number of bytes left in the current packet is known */
+static void rx_ts_next_packet(uint32_t remaining)
+{
+	rx_ts.armed = rx_ts.bytes + remaining + 1;
+	if (!uart_timestamp_arm(UART_TIMESTAMP_RX, rx_ts.armed)) {
+		/* The parser is behind, the next packet is already received */
+		rx_ts.armed = 0;
+	}
+}
+
+static void rx_ts_cmd_complete(void)
+{
+	rx_ts.cmd[rx_ts.cmd_put % ARRAY_SIZE(rx_ts.cmd)] = rx_ts.packet;
+	barrier_dmem_fence_full();
+	rx_ts.cmd_put++;
+}
+
+static void rx_ts_cmd_send(void)
+{
+	if (rx_ts.cmd_get == rx_ts.cmd_put) {
+		rx_ts.current.valid = false;
+		return;
+	}
+
+	rx_ts.current = rx_ts.cmd[rx_ts.cmd_get % ARRAY_SIZE(rx_ts.cmd)];
+	rx_ts.cmd_get++;
+}
+#else
+static inline void rx_ts_consumed(size_t len) {}
+static inline void rx_ts_packet_start(void) {}
+static inline void rx_ts_next_packet(uint32_t remaining) {}
+static inline void rx_ts_cmd_complete(void) {}
+static inline void rx_ts_cmd_send(void) {}
+#endif /* CONFIG_HCI_UART_RX_TIMESTAMP */
+
+/* Bytes taken from the UART by the parser */
+static void h4_rx_consumed(size_t len)
+{
+	H4_STATS_ADD(h2c.bytes, len);
+	rx_ts_consumed(len);
+}
+
+#if defined(CONFIG_HCI_UART_RX_FLOW_CONTROL)
+static void rx_resume_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(rx_resume_work, rx_resume_handler);
+
+/* No buffer available. Receiving stays paused, so the UART deasserts RTS
+ * and the host is throttled, until rx_resume_work got a buffer.
+ */
+static void rx_wait_buf(void)
+{
+	if (rx.state != ST_WAIT_BUF) {
+		TRACE(RX_PAUSE, 1, 0);
+		rx.state = ST_WAIT_BUF;
+	}
+	k_work_schedule(&rx_resume_work,
+			K_USEC(CONFIG_HCI_UART_RX_FLOW_CONTROL_RETRY_US));
+}
+#endif
+
+#if !defined(CONFIG_HCI_UART_ASYNC_RX_ZERO_COPY)
+/* Header received. Allocate buffer and get payload length. On failed
+ * allocation state machine is reset, or receiving is paused in flow
+ * controlled mode. Retries while paused are not counted as failures again.
+ */
+static bool rx_hdr_complete(void)
+{
+	rx.buf = bt_buf_get_tx(BT_BUF_H4, K_NO_WAIT, &rx.type, sizeof(rx.type));
+	if (!rx.buf) {
+		if (rx.state != ST_WAIT_BUF) {
+			H4_STATS_INC(h2c.alloc_failures);
+			TRACE(H2C_DROP, TRACE_DROP_NO_BUF, rx.type);
+		}
+#if defined(CONFIG_HCI_UART_RX_FLOW_CONTROL)
+		uart_irq_rx_disable(hci_uart_dev);
+		rx_wait_buf();
+#else
+		LOG_ERR("No available command buffers!");
+		rx.state = ST_IDLE;
+#endif
+		return false;
+	}
+
+	rx.remaining = get_len(rx.hdr, rx.type);
+	rx_ts_next_packet(rx.remaining);
+
+	net_buf_add_mem(rx.buf, rx.hdr, hdr_len(rx.type));
+	if (rx.remaining > net_buf_tailroom(rx.buf)) {
+		LOG_ERR("Not enough space in buffer");
+		H4_STATS_INC(h2c.discarded);
+		TRACE(H2C_DROP, TRACE_DROP_TOO_LONG, rx.type);
+		net_buf_unref(rx.buf);
+		rx.state = ST_DISCARD;
+	} else {
+		rx.state = ST_PAYLOAD;
+	}
+
+	return true;
+}
+#endif
+
+static void rx_packet_complete(void)
+{
+	TRACE(H2C_PACKET, rx.type, rx.buf->len);
+	H4_STATS_INC(h2c.packets);
+	h4_stats_queue_put(&h4_stats.h2c.queue);
+	if (rx.type == H4_CMD) {
+		rx_ts_cmd_complete();
+	}
+	k_fifo_put(&tx_queue, rx.buf);
+	rx.buf = NULL;
+	rx.state = ST_IDLE;
+}
+
+#if defined(CONFIG_HCI_UART_ASYNC_RX)
+#if defined(CONFIG_HCI_UART_ASYNC_RX_ZERO_COPY)
+/* Scratch target for payloads that are dropped. */
+static uint8_t rx_discard[H4_DISCARD_LEN];
+
+/* Segment the UARTE currently receives into: the packet type byte, the
+ * packet header or the payload. As soon as the header is known, header and
+ * payload are received by DMA straight into the bt_buf_get_tx() buffer.
+ */
+static struct {
+	uint8_t *ptr;
+	size_t len;
+	size_t received;
+} seg = {
+	.ptr = &rx.type,
+	.len = sizeof(rx.type),
+};
+
+static void rx_seg_set(uint8_t *ptr, size_t len)
+{
+	seg.ptr = ptr;
+	seg.len = len;
+	seg.received = 0;
+}
+
+/* Drop the remaining payload of the current packet in chunks */
+static void rx_seg_discard(void)
+{
+	if (rx.remaining == 0) {
+		rx.state = ST_IDLE;
+		rx_seg_set(&rx.type, sizeof(rx.type));
+		return;
+	}
+
+	rx.state = ST_DISCARD;
+	rx_seg_set(rx_discard, MIN(rx.remaining, sizeof(rx_discard)));
+}
+
+/* Advance the H4 state machine after the current segment has been received
+ * and select the next segment.
+ */
+static void h4_rx_seg_complete(void)
+{
+	switch (rx.state) {
+	case ST_IDLE:
+		if (!valid_type(rx.type)) {
+			LOG_WRN("Unknown header %d", rx.type);
+			H4_STATS_INC(h2c.unknown_type);
+			TRACE(H2C_DROP, TRACE_DROP_UNKNOWN_TYPE, rx.type);
+			rx_ts_next_packet(0);
+			rx_seg_set(&rx.type, sizeof(rx.type));
+			break;
+		}
+
+		rx_ts_packet_start();
+		__fallthrough;
+	case ST_WAIT_BUF:
+		/* If allocation fails, the header is still received to know
+		 * how many payload bytes to drop. In flow controlled mode, the
+		 * next segment is not handed to the driver instead, and
+		 * rx_resume_work retries from here.
+		 */
+		rx.buf = bt_buf_get_tx(BT_BUF_H4, K_NO_WAIT, &rx.type, sizeof(rx.type));
+		if (!rx.buf) {
+			if (rx.state != ST_WAIT_BUF) {
+				H4_STATS_INC(h2c.alloc_failures);
+				TRACE(H2C_DROP, TRACE_DROP_NO_BUF, rx.type);
 			}
+#if defined(CONFIG_HCI_UART_RX_FLOW_CONTROL)
+			rx_wait_buf();
 			break;
-		case ST_HDR:
-			read = h4_read(hci_uart_dev,
-				       &hdr_buf[hdr_len(type) - remaining],
-				       remaining);
-			remaining -= read;
-			if (remaining == 0) {
-				/* Header received. Allocate buffer and get
-				 * payload length. If allocation fails leave
-				 * interrupt. On failed allocation state machine
-				 * is reset.
-				 */
-				buf = bt_buf_get_tx(BT_BUF_H4, K_NO_WAIT,
-						    &type, sizeof(type));
-				if (!buf) {
-					LOG_ERR("No available command buffers!");
-					state = ST_IDLE;
-					return;
-				}
+#else
+			LOG_ERR("No available command buffers!");
+#endif
+		}
 
-				remaining = get_len(hdr_buf, type);
+		rx.state = ST_HDR;
+		rx_seg_set(rx.buf ? net_buf_add(rx.buf, hdr_len(rx.type)) : rx.hdr,
+			   hdr_len(rx.type));
+		break;
+	case ST_HDR:
+		/* Header is parsed in place */
+		rx.remaining = get_len(rx.buf ? rx.buf->data : rx.hdr, rx.type);
+		rx_ts_next_packet(rx.remaining);
+
+		if (!rx.buf) {
+			rx_seg_discard();
+		} else if (rx.remaining > net_buf_tailroom(rx.buf)) {
+			LOG_ERR("Not enough space in buffer");
+			H4_STATS_INC(h2c.discarded);
+			TRACE(H2C_DROP, TRACE_DROP_TOO_LONG, rx.type);
+			net_buf_unref(rx.buf);
+			rx.buf = NULL;
+			rx_seg_discard();
+		} else if (rx.remaining == 0) {
+			rx_packet_complete();
+			rx_seg_set(&rx.type, sizeof(rx.type));
+		} else {
+			rx.state = ST_PAYLOAD;
+			rx_seg_set(net_buf_add(rx.buf, rx.remaining), rx.remaining);
+		}
+		break;
+	case ST_PAYLOAD:
+		rx_packet_complete();
+		rx_seg_set(&rx.type, sizeof(rx.type));
+		break;
+	case ST_DISCARD:
+		rx.remaining -= seg.len;
+		rx_seg_discard();
+		break;
+	default:
+		__ASSERT_NO_MSG(0);
+		break;
+	}
+}
 
-				net_buf_add_mem(buf, hdr_buf, hdr_len(type));
-				if (remaining > net_buf_tailroom(buf)) {
-					LOG_ERR("Not enough space in buffer");
-					net_buf_unref(buf);
-					state = ST_DISCARD;
-				} else {
-					state = ST_PAYLOAD;
-				}
+static void h4_rx_rdy(size_t len)
+{
+	int err;
+
+	h4_rx_consumed(len);
+
+	seg.received += len;
+	if (seg.received < seg.len) {
+		return;
+	}
+
+	h4_rx_seg_complete();
+	if (rx.state == ST_WAIT_BUF) {
+		return;
+	}
+
+	/* The next buffer is only known now, the UART_RX_BUF_REQUEST for it
+	 * has been issued when the completed segment was started. The nRF
+	 * UARTE driver restarts RX with a buffer provided this late, bytes
+	 * sent by the host meanwhile are held back by RTS. Other drivers
+	 * disable RX instead, see h4_rx_async_start().
+	 */
+	err = uart_rx_buf_rsp(hci_uart_dev, seg.ptr, seg.len);
+	if (err) {
+		LOG_DBG("Late RX buffer not taken (err %d)", err);
+	}
+}
+
+static int h4_rx_async_start(void)
+{
+	return uart_rx_enable(hci_uart_dev, seg.ptr + seg.received,
+			      seg.len - seg.received,
+			      CONFIG_HCI_UART_ASYNC_RX_TIMEOUT_US);
+}
+#else
+/* DMA receive buffers. While the UARTE fills one of them, the other one is
+ * handed to the driver on UART_RX_BUF_REQUEST.
+ */
+static uint8_t rx_dma_buf[2][CONFIG_HCI_UART_ASYNC_RX_BUF_SIZE];
+static uint8_t rx_dma_buf_next;
+
+/* Walk one received DMA chunk through the H4 state machine. Header and
+ * payload bytes are copied straight from the DMA buffer into their final
+ * location, payloads end up in the bt_buf_get_tx() buffer with one copy.
+ */
+static void h4_rx_chunk(const uint8_t *data, size_t len)
+{
+	size_t n;
 
+	while (len) {
+		switch (rx.state) {
+		case ST_IDLE:
+			rx.type = *data++;
+			len--;
+			h4_rx_consumed(1);
+			if (valid_type(rx.type)) {
+				rx_ts_packet_start();
+				rx.remaining = hdr_len(rx.type);
+				rx.state = ST_HDR;
+			} else {
+				LOG_WRN("Unknown header %d", rx.type);
+				H4_STATS_INC(h2c.unknown_type);
+				TRACE(H2C_DROP, TRACE_DROP_UNKNOWN_TYPE, rx.type);
+				rx_ts_next_packet(0);
+			}
+			break;
+		case ST_HDR:
+			n = MIN(rx.remaining, len);
+			h4_rx_consumed(n);
+			memcpy(&rx.hdr[hdr_len(rx.type) - rx.remaining], data, n);
+			data += n;
+			len -= n;
+			rx.remaining -= n;
+			if (rx.remaining == 0 && rx_hdr_complete() &&
+			    rx.state == ST_PAYLOAD && rx.remaining == 0) {
+				/* Packet without payload */
+				rx_packet_complete();
 			}
 			break;
 		case ST_PAYLOAD:
-			read = h4_read(hci_uart_dev, net_buf_tail(buf),
-				       remaining);
-			buf->len += read;
-			remaining -= read;
-			if (remaining == 0) {
-				/* Packet received */
-				LOG_DBG("putting RX packet in queue.");
-				k_fifo_put(&tx_queue, buf);
-				state = ST_IDLE;
+			n = MIN(rx.remaining, len);
+			h4_rx_consumed(n);
+			net_buf_add_mem(rx.buf, data, n);
+			data += n;
+			len -= n;
+			rx.remaining -= n;
+			if (rx.remaining == 0) {
+				rx_packet_complete();
 			}
 			break;
 		case ST_DISCARD:
-		{
-			uint8_t discard[H4_DISCARD_LEN];
-			size_t to_read = MIN(remaining, sizeof(discard));
+			n = MIN(rx.remaining, len);
+			h4_rx_consumed(n);
+			data += n;
+			len -= n;
+			rx.remaining -= n;
+			if (rx.remaining == 0) {
+				rx.state = ST_IDLE;
+			}
+			break;
+		default:
+			__ASSERT_NO_MSG(0);
+			return;
+		}
+	}
+}
+
+static int h4_rx_async_start(void)
+{
+	rx_dma_buf_next = 1;
+
+	return uart_rx_enable(hci_uart_dev, rx_dma_buf[0], sizeof(rx_dma_buf[0]),
+			      CONFIG_HCI_UART_ASYNC_RX_TIMEOUT_US);
+}
+#endif /* CONFIG_HCI_UART_ASYNC_RX_ZERO_COPY */
+
+/* TX state of the async path. The async API has no scatter-gather, so queued
+ * packets are copied back-to-back into one of two staging buffers: while one
+ * is on the line, the next transfer is staged in the other one. The busy flag
+ * is owned by whoever currently starts transfers, either h4_send() or the
+ * UART_TX_DONE callback. While the owner stages the next transfer, a
+ * UART_TX_DONE only sets done_pending and the owner starts the transfer
+ * itself when it is done staging.
+ */
+static struct {
+	struct net_buf *buf;
+	atomic_t busy;
+	uint8_t idx;
+	size_t staged;
+	bool staging_next;
+	bool done_pending;
+	uint8_t staging[2][CONFIG_HCI_UART_ASYNC_TX_BUF_SIZE];
+} tx;
+
+/* Copy as many queued packets as fit into a staging buffer. A packet that
+ * does not fit completely is continued at the start of the next transfer.
+ */
+static size_t h4_tx_stage(uint8_t *dst)
+{
+	size_t len = 0;
+
+	while (len < CONFIG_HCI_UART_ASYNC_TX_BUF_SIZE) {
+		size_t n;
+
+		if (!tx.buf) {
+			tx.buf = h4_tx_dequeue();
+			if (!tx.buf) {
+				break;
+			}
+		}
+
+		n = MIN(tx.buf->len, CONFIG_HCI_UART_ASYNC_TX_BUF_SIZE - len);
+		memcpy(&dst[len], tx.buf->data, n);
+		net_buf_pull(tx.buf, n);
+		len += n;
+		h4_tx_consumed(n);
+
+		if (!tx.buf->len) {
+			TRACE(C2H_SENT, 0, 0);
+			net_buf_unref(tx.buf);
+			tx.buf = NULL;
+		}
+	}
+
+	return len;
+}
+
+static void h4_tx_async_next(void)
+{
+	while (true) {
+		unsigned int key;
+		bool done;
+		size_t len = tx.staged;
+
+		if (!len) {
+			len = h4_tx_stage(tx.staging[tx.idx]);
+		}
+
+		if (len) {
+			int err;
+
+			/* Set before starting, in case the transfer completes
+			 * before uart_tx() returns
+			 */
+			key = irq_lock();
+			tx.staging_next = true;
+			err = uart_tx(hci_uart_dev, tx.staging[tx.idx], len, SYS_FOREVER_US);
+			tx.staged = 0;
+			if (err) {
+				tx.staging_next = false;
+				irq_unlock(key);
+				LOG_ERR("Unable to start TX (err %d)", err);
+				h4_tx_consumed(-(int32_t)len);
+				continue;
+			}
+			tx.idx ^= 1;
+			irq_unlock(key);
+
+			/* Stage the next transfer while this one is on the line */
+			len = h4_tx_stage(tx.staging[tx.idx]);
+
+			key = irq_lock();
+			tx.staged = len;
+			tx.staging_next = false;
+			done = tx.done_pending;
+			tx.done_pending = false;
+			irq_unlock(key);
+
+			if (!done) {
+				return;
+			}
+
+			/* It completed while staging, start the next one */
+			continue;
+		}
+
+		/* Queue is empty, give up ownership. Re-check to not miss a
+		 * buffer that h4_send() queued while we still were busy.
+		 */
+		atomic_clear(&tx.busy);
+		h4_tx_idle();
+		if (h4_tx_queue_empty() || !atomic_cas(&tx.busy, 0, 1)) {
+			return;
+		}
+	}
+}
+
+/* UART_TX_DONE and UART_TX_ABORTED, leave the next transfer to the owner if
+ * it is still staging it
+ */
+static void h4_tx_async_done(void)
+{
+	unsigned int key = irq_lock();
+
+	if (tx.staging_next) {
+		tx.done_pending = true;
+		irq_unlock(key);
+		return;
+	}
+	irq_unlock(key);
+
+	h4_tx_async_next();
+}
+
+static void bt_uart_async_cb(const struct device *dev, struct uart_event *evt,
+			     void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	switch (evt->type) {
+#if defined(CONFIG_HCI_UART_ASYNC_RX_ZERO_COPY)
+	case UART_RX_RDY: {
+		PROF_START(RX_ISR);
+		h4_rx_rdy(evt->data.rx.len);
+		PROF_STOP(RX_ISR);
+		break;
+	}
+	case UART_RX_BUF_REQUEST:
+		/* Answered by h4_rx_rdy() once the next segment is known */
+		break;
+#else
+	case UART_RX_RDY: {
+		PROF_START(RX_ISR);
+		h4_rx_chunk(evt->data.rx.buf + evt->data.rx.offset, evt->data.rx.len);
+		PROF_STOP(RX_ISR);
+		break;
+	}
+	case UART_RX_BUF_REQUEST:
+		uart_rx_buf_rsp(dev, rx_dma_buf[rx_dma_buf_next], sizeof(rx_dma_buf[0]));
+		rx_dma_buf_next ^= 1;
+		break;
+#endif
+	case UART_RX_BUF_RELEASED:
+		break;
+	case UART_RX_STOPPED:
+		LOG_WRN("RX stopped (reason %d)", evt->data.rx_stop.reason);
+		break;
+	case UART_RX_DISABLED:
+		/* Receiving is only disabled on purpose while waiting for a
+		 * buffer, restart it otherwise. In zero copy mode, this
+		 * continues with the pending segment.
+		 */
+		if (rx.state != ST_WAIT_BUF && h4_rx_async_start()) {
+			LOG_ERR("Unable to restart RX");
+		}
+		break;
+	case UART_TX_ABORTED:
+		LOG_WRN("TX aborted after %u bytes", evt->data.tx.len);
+		h4_tx_async_done();
+		break;
+	case UART_TX_DONE: {
+		PROF_START(TX_ISR);
+		h4_tx_async_done();
+		PROF_STOP(TX_ISR);
+		break;
+	}
+	default:
+		break;
+	}
+}
+#else
+static void rx_isr(void)
+{
+	int read;
+
+	do {
+		switch (rx.state) {
+		case ST_IDLE:
+			/* Get packet type */
+			read = h4_read(hci_uart_dev, &rx.type, sizeof(rx.type));
+			/* since we read in loop until no data is in the fifo,
+			 * it is possible that read = 0.
+			 */
+			if (read) {
+				if (valid_type(rx.type)) {
+					rx_ts_packet_start();
+					/* Get expected header size and switch
+					 * to receiving header.
+					 */
+					rx.remaining = hdr_len(rx.type);
+					rx.state = ST_HDR;
+				} else {
+					LOG_WRN("Unknown header %d", rx.type);
+					H4_STATS_INC(h2c.unknown_type);
+					TRACE(H2C_DROP, TRACE_DROP_UNKNOWN_TYPE, rx.type);
+					rx_ts_next_packet(0);
+				}
+			}
+			break;
+		case ST_HDR:
+			read = h4_read(hci_uart_dev,
+				       &rx.hdr[hdr_len(rx.type) - rx.remaining],
+				       rx.remaining);
+			rx.remaining -= read;
+			if (rx.remaining == 0) {
+				/* If allocation fails leave interrupt. */
+				if (!rx_hdr_complete()) {
+					return;
+				}
+			}
+			break;
+		case ST_PAYLOAD:
+			read = h4_read(hci_uart_dev, net_buf_tail(rx.buf),
+				       rx.remaining);
+			rx.buf->len += read;
+			rx.remaining -= read;
+			if (rx.remaining == 0) {
+				/* Packet received */
+				rx_packet_complete();
+			}
+			break;
+		case ST_DISCARD:
+		{
+			uint8_t discard[H4_DISCARD_LEN];
+			size_t to_read = MIN(rx.remaining, sizeof(discard));
+
+			read = h4_read(hci_uart_dev, discard, to_read);
+			rx.remaining -= read;
+			if (rx.remaining == 0) {
+				rx.state = ST_IDLE;
+			}
+
+			break;
+
+		}
+		case ST_WAIT_BUF:
+			/* Paused, rx_resume_work re-enables RX */
+			read = 0;
+			break;
+		default:
+			read = 0;
+			__ASSERT_NO_MSG(0);
+			break;
+
+		}
+	} while (read);
+}
+
+static void tx_isr(void)
+{
+	static struct net_buf *buf;
+	int len;
+
+	if (!buf) {
+		buf = h4_tx_dequeue();
+		if (!buf) {
+			uart_irq_tx_disable(hci_uart_dev);
+			h4_tx_idle();
+			return;
+		}
+	}
+
+	len = uart_fifo_fill(hci_uart_dev, buf->data, buf->len);
+	h4_tx_consumed(len);
+	net_buf_pull(buf, len);
+	if (!buf->len) {
+		TRACE(C2H_SENT, 0, 0);
+		net_buf_unref(buf);
+		buf = NULL;
+	}
+}
+
+static void bt_uart_isr(const struct device *unused, void *user_data)
+{
+	ARG_UNUSED(unused);
+	ARG_UNUSED(user_data);
+
+	if (!(uart_irq_rx_ready(hci_uart_dev) ||
+	      uart_irq_tx_ready(hci_uart_dev))) {
+		TRACE(UART_SPURIOUS, 0, 0);
+	}
+
+	if (uart_irq_tx_ready(hci_uart_dev)) {
+		PROF_START(TX_ISR);
+		tx_isr();
+		PROF_STOP(TX_ISR);
+	}
+
+	if (uart_irq_rx_ready(hci_uart_dev)) {
+		PROF_START(RX_ISR);
+		rx_isr();
+		PROF_STOP(RX_ISR);
+	}
+}
+#endif /* CONFIG_HCI_UART_ASYNC_RX */
+
+#if defined(CONFIG_HCI_UART_RX_FLOW_CONTROL)
+/* Retry the allocation that paused receiving and resume on success. IRQs are
+ * locked as the state is shared with the UART interrupt.
+ */
+static void rx_resume_handler(struct k_work *work)
+{
+	unsigned int key;
+	bool resume;
+
+	ARG_UNUSED(work);
+
+	key = irq_lock();
+	if (rx.state != ST_WAIT_BUF) {
+		irq_unlock(key);
+		return;
+	}
+#if defined(CONFIG_HCI_UART_ASYNC_RX_ZERO_COPY)
+	h4_rx_seg_complete();
+#else
+	(void)rx_hdr_complete();
+#endif
+	resume = rx.state != ST_WAIT_BUF;
+	irq_unlock(key);
+
+	if (!resume) {
+		return;
+	}
+
+	TRACE(RX_PAUSE, 0, 0);
+#if defined(CONFIG_HCI_UART_ASYNC_RX)
+	/* -EBUSY: RX is not disabled yet, UART_RX_DISABLED restarts it */
+	int err = h4_rx_async_start();
+
+	if (err && err != -EBUSY) {
+		LOG_ERR("Unable to resume RX (err %d)", err);
+	}
+#else
+	uart_irq_rx_enable(hci_uart_dev);
+#endif
+}
+#endif /* CONFIG_HCI_UART_RX_FLOW_CONTROL */
+
+#if defined(CONFIG_HCI_UART_BENCH)
+#define TRANSPORT_BENCH_OFF		0x00	/* Pass data to the controller */
+#define TRANSPORT_BENCH_LOOPBACK	0x01	/* Send data back to the host */
+#define TRANSPORT_BENCH_SINK		0x02	/* Drop data */
+#define TRANSPORT_BENCH_CONTROLLER	0x03	/* Timestamp and pass to the controller */
+
+static atomic_t bench_mode;
+
+static int h4_send(struct net_buf *buf);
+
+/* Take ACL and ISO data from the controller path while benchmarking. The
+ * buffer is reused for the loopback, the H4 type of data from the host and
+ * to the host is the same.
+ */
+static bool bench_handle(struct net_buf *buf)
+{
+	enum bt_buf_type type = bt_buf_get_type(buf);
+	uint8_t h4_type = type == BT_BUF_ACL_OUT ? H4_ACL : H4_ISO;
+	atomic_val_t mode = atomic_get(&bench_mode);
+
+	if (mode == TRANSPORT_BENCH_OFF ||
+	    (type != BT_BUF_ACL_OUT && type != BT_BUF_ISO_OUT)) {
+		return false;
+	}
+
+	if (mode == TRANSPORT_BENCH_SINK) {
+		net_buf_unref(buf);
+		return true;
+	}
+
+	/* ACL and ISO headers are both 4 bytes */
+	if (buf->len >= sizeof(struct bt_hci_acl_hdr) + sizeof(uint64_t)) {
+		sys_put_le64(controller_time_us_get(),
+			     buf->data + sizeof(struct bt_hci_acl_hdr));
+	}
+
+	if (mode == TRANSPORT_BENCH_CONTROLLER) {
+		/* Comes back from the controller, e.g. the native_sim stub, through
+		 * the same path as received data
+		 */
+		return false;
+	}
+
+	bt_buf_set_type(buf, type == BT_BUF_ACL_OUT ? BT_BUF_ACL_IN : BT_BUF_ISO_IN);
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		if (!net_buf_headroom(buf)) {
+			H4_STATS_INC(h2c.send_errors);
+			net_buf_unref(buf);
+			return true;
+		}
+		net_buf_push_u8(buf, h4_type);
+	}
+
+	h4_send(buf);
+
+	return true;
+}
+#else
+static inline bool bench_handle(struct net_buf *buf)
+{
+	return false;
+}
+#endif /* CONFIG_HCI_UART_BENCH */
+
+static void tx_send(struct net_buf *buf)
+{
+	enum bt_buf_type type = bt_buf_get_type(buf);
+	int err;
+
+	if (type == BT_BUF_CMD) {
+		rx_ts_cmd_send();
+	}
+
+	if (bench_handle(buf)) {
+		return;
+	}
+
+	/* Pass buffer to the stack. The timesync command handler stops the
+	 * mark when its response is queued.
+	 */
+	PROF_START(BT_SEND);
+	PROF_MARK(TIMESYNC_RESPONSE);
+	err = bt_send(buf);
+	PROF_STOP(BT_SEND);
+	TRACE(BT_SEND, type, err);
+        if (err!=BT_HCI_ERR_SUCCESS) {
+            if (err!=BT_HCI_ERR_EXT_HANDLED) {
+                LOG_ERR("Unable to send (err %d)", err);
+                H4_STATS_INC(h2c.send_errors);
+            }
+            net_buf_unref(buf);
+        }
+
+#if defined(CONFIG_HCI_UART_RX_FLOW_CONTROL)
+	/* The controller may have freed a buffer, retry right away */
+	if (rx.state == ST_WAIT_BUF) {
+		k_work_reschedule(&rx_resume_work, K_NO_WAIT);
+	}
+#endif
+}
+
+static void tx_thread(void *p1, void *p2, void *p3)
+{
+	while (1) {
+		struct net_buf *buf;
+		uint32_t batch_start;
+		uint32_t batch_count = 0;
+
+		/* Wait until a buffer is available */
+		buf = k_fifo_get(&tx_queue, K_FOREVER);
+		h4_stats_queue_get(&h4_stats.h2c.queue);
+		batch_start = k_cycle_get_32();
+
+		/* Pass all pending buffers to the stack in one wake-up */
+		do {
+			tx_send(buf);
+			batch_count++;
+
+			/* Give other threads a chance to run if tx_queue keeps
+			 * getting new data all the time.
+			 */
+			if (batch_count >= CONFIG_HCI_UART_TX_BATCH_MAX_PACKETS ||
+			    (CONFIG_HCI_UART_TX_BATCH_MAX_US &&
+			     k_cyc_to_us_floor32(k_cycle_get_32() - batch_start) >=
+			     CONFIG_HCI_UART_TX_BATCH_MAX_US)) {
+				k_yield();
+				batch_start = k_cycle_get_32();
+				batch_count = 0;
+			}
+
+			buf = k_fifo_get(&tx_queue, K_NO_WAIT);
+			if (buf) {
+				h4_stats_queue_get(&h4_stats.h2c.queue);
+			}
+		} while (buf);
+	}
+}
+
+/* Start the TX engine unless it is running already */
+static void h4_tx_kick(void)
+{
+#if defined(CONFIG_HCI_UART_ASYNC_RX)
+	if (atomic_cas(&tx.busy, 0, 1)) {
+		h4_tx_async_next();
+	}
+#else
+	uart_irq_tx_enable(hci_uart_dev);
+#endif
+}
+
+static int h4_send(struct net_buf *buf)
+{
+	TRACE(C2H_QUEUE, bt_buf_get_type(buf), buf->len);
+
+	iso_sdu_report(buf);
+	h4_tx_enqueue(buf);
+	h4_tx_kick();
+
+	return 0;
+}
+
+#if defined(CONFIG_BT_CTLR_ASSERT_HANDLER)
+void bt_ctlr_assert_handle(char *file, uint32_t line)
+{
+	uint32_t len = 0U, pos = 0U;
+
+	/* Disable interrupts, this is unrecoverable */
+	(void)irq_lock();
+
+#if defined(CONFIG_HCI_UART_ASYNC_RX)
+	(void)uart_rx_disable(hci_uart_dev);
+	(void)uart_tx_abort(hci_uart_dev);
+#else
+	uart_irq_rx_disable(hci_uart_dev);
+	uart_irq_tx_disable(hci_uart_dev);
+#endif
+
+	if (file) {
+		while (file[len] != '\0') {
+			if (file[len] == '/') {
+				pos = len + 1;
+			}
+			len++;
+		}
+		file += pos;
+		len -= pos;
+	}
+
+	uart_poll_out(hci_uart_dev, H4_EVT);
+	/* Vendor-Specific debug event */
+	uart_poll_out(hci_uart_dev, 0xff);
+	/* 0xAA + strlen + \0 + 32-bit line number */
+	uart_poll_out(hci_uart_dev, 1 + len + 1 + 4);
+	uart_poll_out(hci_uart_dev, 0xAA);
+
+	if (len) {
+		while (*file != '\0') {
+			uart_poll_out(hci_uart_dev, *file);
+			file++;
+		}
+		uart_poll_out(hci_uart_dev, 0x00);
+	}
+
+	uart_poll_out(hci_uart_dev, line >> 0 & 0xff);
+	uart_poll_out(hci_uart_dev, line >> 8 & 0xff);
+	uart_poll_out(hci_uart_dev, line >> 16 & 0xff);
+	uart_poll_out(hci_uart_dev, line >> 24 & 0xff);
+
+	while (1) {
+	}
+}
+#endif /* CONFIG_BT_CTLR_ASSERT_HANDLER */
+
+static int hci_uart_init(void)
+{
+	LOG_DBG("");
+
+	if (IS_ENABLED(CONFIG_USB_CDC_ACM)) {
+		if (usb_enable(NULL)) {
+			LOG_ERR("Failed to enable USB");
+			return -EINVAL;
+		}
+	}
+
+	if (!device_is_ready(hci_uart_dev)) {
+		LOG_ERR("HCI UART %s is not ready", hci_uart_dev->name);
+		return -EINVAL;
+	}
+
+	h4_tx_queue_init();
+
+#if defined(CONFIG_HCI_UART_PROF)
+	if (prof_init()) {
+		LOG_ERR("Unable to start the cycle counter");
+	}
+#endif
+
+#if defined(CONFIG_HCI_UART_RX_TIMESTAMP) || defined(CONFIG_HCI_UART_TX_TIMESTAMP)
+	if (uart_timestamp_init()) {
+		LOG_ERR("Unable to set up UART timestamps");
+	}
+
+	/* The first byte starts a packet */
+	rx_ts_next_packet(0);
+#endif
+
+#if defined(CONFIG_HCI_UART_ASYNC_RX)
+	int err;
+
+	err = uart_callback_set(hci_uart_dev, bt_uart_async_cb, NULL);
+	if (err) {
+		LOG_ERR("Unable to set UART callback (err %d)", err);
+		return err;
+	}
+
+	err = h4_rx_async_start();
+	if (err) {
+		LOG_ERR("Unable to enable RX (err %d)", err);
+		return err;
+	}
+#else
+	uart_irq_rx_disable(hci_uart_dev);
+	uart_irq_tx_disable(hci_uart_dev);
+
+	uart_irq_callback_set(hci_uart_dev, bt_uart_isr);
+
+	uart_irq_rx_enable(hci_uart_dev);
+#endif
+
+	return 0;
+}
+
+SYS_INIT(hci_uart_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEVICE);
+
+#define ENABLE_ISO_TIMESYNC
+
+#ifdef ENABLE_ISO_TIMESYNC
+
+#define TIMESYNC_GPIO  DT_NODELABEL(timesync)
+
+#if DT_NODE_HAS_STATUS(TIMESYNC_GPIO, okay)
+static const struct gpio_dt_spec timesync_pin = GPIO_DT_SPEC_GET(TIMESYNC_GPIO, gpios);
+#else
+#error "No timesync gpio available!"
+#endif
+
+#if defined(CONFIG_HCI_UART_TIMESYNC_HW_PULSE)
+/* The pin is driven by GPIOTE, set once timesync_pulse_init() succeeded.
+ * Otherwise it is toggled by GPIO and pulses cannot be scheduled.
+ */
+static bool timesync_hw_pulse;
+#endif
+
+/* Flags parameter: response format in the lower bits */
+#define ISO_TIMESYNC_FLAGS_FORMAT_MASK	0x03
+#define ISO_TIMESYNC_FORMAT_32		0x00	/* 32-bit timestamp, wraps after ~71 min */
+#define ISO_TIMESYNC_FORMAT_64		0x01	/* 64-bit timestamp with fraction */
+#define ISO_TIMESYNC_FORMAT_ARRIVAL	0x02	/* 64-bit format plus command arrival */
+/* Report the start of the response on the UART in a follow-up vendor event */
+#define ISO_TIMESYNC_FLAGS_TX_REPORT	0x04
+
+struct hci_cmd_iso_timestamp_response {
+    struct bt_hci_evt_cc_status cc;
+    uint32_t timestamp;
+} __packed;
+
+struct hci_cmd_iso_timestamp_response_64 {
+	struct bt_hci_evt_cc_status cc;
+	uint8_t format;
+	uint64_t timestamp_us;
+	/* Sub-microsecond part in 1/65536 us, 0 if not resolved */
+	uint16_t timestamp_frac;
+} __packed;
+
+struct hci_cmd_iso_timestamp_response_arrival {
+	struct hci_cmd_iso_timestamp_response_64 rsp;
+	/* Start of the command on the UART, 0 if not captured */
+	uint64_t arrival_us;
+} __packed;
+
+#if defined(CONFIG_HCI_UART_TX_TIMESTAMP)
+struct hci_evt_vs_timesync_tx {
+	uint8_t subevent;
+	uint64_t timestamp_us;
+} __packed;
+
+/* Report the controller time the last timesync response started on the
+ * UART, once its first byte has been sent. Reports are dropped if no event
+ * buffer is available.
+ */
+static void tx_ts_report_handler(struct k_work *work)
+{
+	struct hci_evt_vs_timesync_tx *evt;
+	struct bt_hci_evt_hdr *hdr;
+	struct net_buf *buf;
+	uint64_t timestamp_us;
+	uint32_t ref_ticks;
+	uint32_t ticks;
+	unsigned int key;
+
+	if (!uart_timestamp_get(UART_TIMESTAMP_TX, &ticks)) {
+		if (k_uptime_get() < tx_ts.deadline) {
+			k_work_schedule(k_work_delayable_from_work(work),
+					K_USEC(TX_TS_REPORT_POLL_US));
+		}
+		return;
+	}
+
+	key = irq_lock();
+	timestamp_us = controller_time_capture_us();
+	ref_ticks = uart_timestamp_now();
+	irq_unlock(key);
+
+	buf = bt_buf_get_evt(BT_HCI_EVT_VENDOR, true, K_NO_WAIT);
+	if (!buf) {
+		H4_STATS_ATOMIC_INC(c2h.evt_drops);
+		TRACE(EVT_DROP, HCI_EVT_VS_TIMESYNC_TX, 0);
+		return;
+	}
+
+	hdr = net_buf_add(buf, sizeof(*hdr));
+	hdr->evt = BT_HCI_EVT_VENDOR;
+	hdr->len = sizeof(*evt);
+
+	evt = net_buf_add(buf, sizeof(*evt));
+	evt->subevent = HCI_EVT_VS_TIMESYNC_TX;
+	evt->timestamp_us = sys_cpu_to_le64(
+		uart_timestamp_to_controller_time(ticks, timestamp_us, ref_ticks));
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(buf, H4_EVT);
+	}
+
+	h4_send(buf);
+}
+#endif /* CONFIG_HCI_UART_TX_TIMESTAMP */
+
+/* Event and Command Complete header of the timesync response, the length
+ * is set per format
+ */
+struct timesync_rsp_hdr {
+	struct bt_hci_evt_hdr hdr;
+	struct bt_hci_evt_cmd_complete cc;
+} __packed;
+
+static const struct timesync_rsp_hdr timesync_rsp_template = {
+	.hdr = {
+		.evt = BT_HCI_EVT_CMD_COMPLETE,
+	},
+	.cc = {
+		.ncmd = 1,
+		.opcode = sys_cpu_to_le16(BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC)),
+	},
+};
+
+/* Event buffer set aside for the next timesync response, so that the
+ * response does not depend on the event pool. Taken and refilled by the
+ * command handler only. It is permanently missing from the pool, which the
+ * configurations size one larger for it.
+ */
+static struct net_buf *timesync_rsp_spare;
+
+static void timesync_rsp_prealloc(void)
+{
+	if (!timesync_rsp_spare) {
+		timesync_rsp_spare = bt_buf_get_evt(BT_HCI_EVT_CMD_COMPLETE, false, K_NO_WAIT);
+	}
+}
+
+static struct net_buf *timesync_rsp_get(size_t param_len)
+{
+	struct net_buf *rsp = timesync_rsp_spare;
+	struct timesync_rsp_hdr *hdr;
+
+	if (!rsp) {
+		return bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC),
+						  param_len);
+	}
+
+	timesync_rsp_spare = NULL;
+	hdr = net_buf_add_mem(rsp, &timesync_rsp_template, sizeof(*hdr));
+	hdr->hdr.len = sizeof(hdr->cc) + param_len;
+
+	return rsp;
+}
+
+/* Critical path: check the flags, capture the time and toggle the pin with
+ * IRQs locked, then fill the set aside response. Diagnostics go to the
+ * trace after the response has been queued.
+ */
+uint8_t hci_cmd_iso_timesync_cb(struct net_buf *buf)
+{
+	const uint8_t flags = buf->data[0];
+	const uint8_t format = flags & ISO_TIMESYNC_FLAGS_FORMAT_MASK;
+	uint64_t timestamp_us;
+	uint64_t arrival_us = 0;
+	struct net_buf *rsp;
+	uint32_t key;
+
+	if ((format != ISO_TIMESYNC_FORMAT_32 && format != ISO_TIMESYNC_FORMAT_64 &&
+	     !(IS_ENABLED(CONFIG_HCI_UART_RX_TIMESTAMP) &&
+	       format == ISO_TIMESYNC_FORMAT_ARRIVAL)) ||
+	    (!IS_ENABLED(CONFIG_HCI_UART_TX_TIMESTAMP) &&
+	     (flags & ISO_TIMESYNC_FLAGS_TX_REPORT))) {
+		TRACE(TIMESYNC, flags, BT_HCI_ERR_INVALID_PARAM);
+		return BT_HCI_ERR_INVALID_PARAM;
+	}
+
+	// Lock interrupts to avoid interrupt between time capture and gpio toggle
+	key = arch_irq_lock();
+	PROF_START(TIMESYNC_LOCKED);
+
+	timestamp_us = controller_time_capture_us();
+
+#if defined(CONFIG_HCI_UART_RX_TIMESTAMP)
+	/* Reference for the arrival time, right after the capture */
+	uint32_t ref_ticks = uart_timestamp_now();
+
+	if (rx_ts.current.valid) {
+		arrival_us = uart_timestamp_to_controller_time(rx_ts.current.ticks,
+							       timestamp_us, ref_ticks);
+	}
+#endif
+
+#if defined(CONFIG_HCI_UART_TIMESYNC_HW_PULSE)
+	if (timesync_hw_pulse) {
+		timesync_pulse_toggle();
+	} else {
+		gpio_pin_toggle_dt(&timesync_pin);
+	}
+#elif DT_NODE_HAS_STATUS(TIMESYNC_GPIO, okay)
+	gpio_pin_toggle_dt( &timesync_pin );
+#endif
+
+	PROF_STOP(TIMESYNC_LOCKED);
+	// Unlock interrupts
+	arch_irq_unlock(key);
+
+	// emit event
+	if (format == ISO_TIMESYNC_FORMAT_ARRIVAL) {
+		struct hci_cmd_iso_timestamp_response_arrival *response;
+
+		rsp = timesync_rsp_get(sizeof(*response));
+		response = net_buf_add(rsp, sizeof(*response));
+		response->rsp.cc.status = BT_HCI_ERR_SUCCESS;
+		response->rsp.format = format;
+		response->rsp.timestamp_us = sys_cpu_to_le64(timestamp_us);
+		response->rsp.timestamp_frac = 0;
+		response->arrival_us = sys_cpu_to_le64(arrival_us);
+	} else if (format == ISO_TIMESYNC_FORMAT_64) {
+		struct hci_cmd_iso_timestamp_response_64 *response;
+
+		rsp = timesync_rsp_get(sizeof(*response));
+		response = net_buf_add(rsp, sizeof(*response));
+		response->cc.status = BT_HCI_ERR_SUCCESS;
+		response->format = format;
+		response->timestamp_us = sys_cpu_to_le64(timestamp_us);
+		/* None of the time sources resolves below 1 us yet */
+		response->timestamp_frac = 0;
+	} else {
+		struct hci_cmd_iso_timestamp_response *response;
+
+		rsp = timesync_rsp_get(sizeof(*response));
+		response = net_buf_add(rsp, sizeof(*response));
+		response->cc.status = BT_HCI_ERR_SUCCESS;
+		response->timestamp = sys_cpu_to_le32((uint32_t)timestamp_us);
+	}
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
+	}
+
+#if defined(CONFIG_HCI_UART_TX_TIMESTAMP)
+	if (flags & ISO_TIMESYNC_FLAGS_TX_REPORT) {
+		/* Armed by the TX engine when it takes the response */
+		tx_ts.buf = rsp;
+	}
+#endif
+
+	PROF_STOP_MARK(TIMESYNC_RESPONSE);
+	h4_send(rsp);
+
+	TRACE(TIMESYNC, flags, BT_HCI_ERR_SUCCESS);
+	timesync_rsp_prealloc();
+
+	return BT_HCI_ERR_EXT_HANDLED;
+}
+
+#if defined(CONFIG_HCI_UART_TIMESYNC_HW_PULSE)
+struct hci_cmd_iso_timesync_schedule {
+	uint64_t timestamp_us;
+} __packed;
+
+struct hci_cmd_iso_timesync_schedule_response {
+	struct bt_hci_evt_cc_status cc;
+	uint64_t timestamp_us;
+} __packed;
+
+/* Toggle the timesync pin at the given controller time by (D)PPI. The
+ * response carries the time the edge has actually been scheduled for.
+ */
+uint8_t hci_cmd_iso_timesync_schedule_cb(struct net_buf *buf)
+{
+	const struct hci_cmd_iso_timesync_schedule *cmd = (const void *)buf->data;
+	struct hci_cmd_iso_timesync_schedule_response *response;
+	struct net_buf *rsp;
+	uint64_t timestamp_us = sys_le64_to_cpu(cmd->timestamp_us);
+
+	if (!timesync_hw_pulse) {
+		return BT_HCI_ERR_UNSUPP_FEATURE_PARAM_VAL;
+	}
+
+	if (timesync_pulse_train_active()) {
+		return BT_HCI_ERR_CMD_DISALLOWED;
+	}
+
+	if (timesync_pulse_schedule(&timestamp_us)) {
+		return BT_HCI_ERR_INVALID_PARAM;
+	}
+
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC_SCHEDULE),
+					 sizeof(*response));
+	response = net_buf_add(rsp, sizeof(*response));
+	response->cc.status = BT_HCI_ERR_SUCCESS;
+	response->timestamp_us = sys_cpu_to_le64(timestamp_us);
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
+	}
+
+	h4_send(rsp);
+
+	return BT_HCI_ERR_EXT_HANDLED;
+}
+
+struct hci_cmd_iso_timesync_train {
+	/* 0 stops the pulse train */
+	uint32_t period_us;
+	/* Report every Nth edge, 0 for no reports */
+	uint16_t report_interval;
+} __packed;
+
+struct hci_cmd_iso_timesync_train_response {
+	struct bt_hci_evt_cc_status cc;
+	uint64_t first_edge_us;
+} __packed;
+
+struct hci_evt_vs_timesync_edge {
+	uint8_t subevent;
+	uint32_t edge;
+	uint64_t timestamp_us;
+} __packed;
+
+static uint16_t timesync_train_report_interval;
+
+/* Called from the train timer interrupt. Reports are dropped if no event
+ * buffer is available.
+ */
+static void timesync_train_edge_cb(uint32_t edge, uint64_t timestamp_us)
+{
+	struct hci_evt_vs_timesync_edge *evt;
+	struct bt_hci_evt_hdr *hdr;
+	struct net_buf *buf;
+
+	if (!timesync_train_report_interval || edge % timesync_train_report_interval) {
+		return;
+	}
+
+	buf = bt_buf_get_evt(BT_HCI_EVT_VENDOR, true, K_NO_WAIT);
+	if (!buf) {
+		H4_STATS_ATOMIC_INC(c2h.evt_drops);
+		TRACE(EVT_DROP, HCI_EVT_VS_TIMESYNC_EDGE, 0);
+		return;
+	}
+
+	hdr = net_buf_add(buf, sizeof(*hdr));
+	hdr->evt = BT_HCI_EVT_VENDOR;
+	hdr->len = sizeof(*evt);
+
+	evt = net_buf_add(buf, sizeof(*evt));
+	evt->subevent = HCI_EVT_VS_TIMESYNC_EDGE;
+	evt->edge = sys_cpu_to_le32(edge);
+	evt->timestamp_us = sys_cpu_to_le64(timestamp_us);
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(buf, H4_EVT);
+	}
+
+	h4_send(buf);
+}
+
+/* Start or stop a periodic pulse train on the timesync pin. Edges are on a
+ * grid of the period in controller time and reported by vendor events.
+ */
+uint8_t hci_cmd_iso_timesync_train_cb(struct net_buf *buf)
+{
+	const struct hci_cmd_iso_timesync_train *cmd = (const void *)buf->data;
+	struct hci_cmd_iso_timesync_train_response *response;
+	struct net_buf *rsp;
+	uint32_t period_us = sys_le32_to_cpu(cmd->period_us);
+	uint64_t first_edge_us = 0;
+
+	if (!timesync_hw_pulse) {
+		return BT_HCI_ERR_UNSUPP_FEATURE_PARAM_VAL;
+	}
+
+	if (period_us == 0) {
+		timesync_pulse_train_stop();
+	} else {
+		timesync_train_report_interval = sys_le16_to_cpu(cmd->report_interval);
+		if (timesync_pulse_train_start(period_us, timesync_train_edge_cb,
+					       &first_edge_us)) {
+			return BT_HCI_ERR_INVALID_PARAM;
+		}
+	}
+
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC_TRAIN),
+					 sizeof(*response));
+	response = net_buf_add(rsp, sizeof(*response));
+	response->cc.status = BT_HCI_ERR_SUCCESS;
+	response->first_edge_us = sys_cpu_to_le64(first_edge_us);
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
+	}
+
+	h4_send(rsp);
+
+	return BT_HCI_ERR_EXT_HANDLED;
+}
+#endif /* CONFIG_HCI_UART_TIMESYNC_HW_PULSE */
 
-			read = h4_read(hci_uart_dev, discard, to_read);
-			remaining -= read;
-			if (remaining == 0) {
-				state = ST_IDLE;
-			}
+#if defined(CONFIG_HCI_UART_TIMESYNC_MODEL)
+/* Flags of the model command */
+#define ISO_TIMESYNC_MODEL_FLAGS_RESET	0x01
 
-			break;
+struct hci_cmd_iso_timesync_model {
+	uint8_t flags;
+	/* Host time at which the command was sent */
+	uint64_t host_us;
+} __packed;
 
-		}
-		default:
-			read = 0;
-			__ASSERT_NO_MSG(0);
-			break;
+struct hci_cmd_iso_timesync_model_response {
+	struct bt_hci_evt_cc_status cc;
+	/* Controller time paired with host_us */
+	uint64_t controller_us;
+	int64_t offset_ns;
+	int32_t skew_ppb;
+	uint32_t residual_ns;
+	uint8_t samples;
+} __packed;
 
-		}
-	} while (read);
-}
+static struct timesync_model timesync_model;
 
-static void tx_isr(void)
+/* Controller time of the command that is being handled: its arrival on the
+ * UART if captured, the time it is handled otherwise.
+ */
+static uint64_t timesync_cmd_time_get(void)
 {
-	static struct net_buf *buf;
-	int len;
+	uint64_t now_us;
+	unsigned int key;
 
-	if (!buf) {
-		buf = k_fifo_get(&uart_tx_queue, K_NO_WAIT);
-		if (!buf) {
-			uart_irq_tx_disable(hci_uart_dev);
-			return;
-		}
-	}
+	key = irq_lock();
+	now_us = controller_time_capture_us();
+#if defined(CONFIG_HCI_UART_RX_TIMESTAMP)
+	uint32_t ref_ticks = uart_timestamp_now();
+#endif
+	irq_unlock(key);
 
-	len = uart_fifo_fill(hci_uart_dev, buf->data, buf->len);
-	net_buf_pull(buf, len);
-	if (!buf->len) {
-		net_buf_unref(buf);
-		buf = NULL;
+#if defined(CONFIG_HCI_UART_RX_TIMESTAMP)
+	if (rx_ts.current.valid) {
+		return uart_timestamp_to_controller_time(rx_ts.current.ticks, now_us,
+							 ref_ticks);
 	}
+#endif
+
+	return now_us;
 }
 
-static void bt_uart_isr(const struct device *unused, void *user_data)
+/* Add the host reference time to the drift model and return the fitted
+ * offset and skew, so the host does not need its own regression.
+ */
+uint8_t hci_cmd_iso_timesync_model_cb(struct net_buf *buf)
 {
-	ARG_UNUSED(unused);
-	ARG_UNUSED(user_data);
+	const struct hci_cmd_iso_timesync_model *cmd = (const void *)buf->data;
+	struct hci_cmd_iso_timesync_model_response *response;
+	struct timesync_model_fit fit;
+	struct net_buf *rsp;
+	uint64_t controller_us = timesync_cmd_time_get();
 
-	if (!(uart_irq_rx_ready(hci_uart_dev) ||
-	      uart_irq_tx_ready(hci_uart_dev))) {
-		LOG_DBG("spurious interrupt");
+	if (cmd->flags & ISO_TIMESYNC_MODEL_FLAGS_RESET) {
+		timesync_model_reset(&timesync_model);
 	}
 
-	if (uart_irq_tx_ready(hci_uart_dev)) {
-		tx_isr();
-	}
+	timesync_model_add(&timesync_model, sys_le64_to_cpu(cmd->host_us), controller_us);
+	timesync_model_fit(&timesync_model, &fit);
 
-	if (uart_irq_rx_ready(hci_uart_dev)) {
-		rx_isr();
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC_MODEL),
+					 sizeof(*response));
+	response = net_buf_add(rsp, sizeof(*response));
+	response->cc.status = BT_HCI_ERR_SUCCESS;
+	response->controller_us = sys_cpu_to_le64(controller_us);
+	response->offset_ns = sys_cpu_to_le64(fit.offset_ns);
+	response->skew_ppb = sys_cpu_to_le32(fit.skew_ppb);
+	response->residual_ns = sys_cpu_to_le32(fit.residual_ns);
+	response->samples = fit.samples;
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
 	}
+
+	h4_send(rsp);
+
+	return BT_HCI_ERR_EXT_HANDLED;
 }
+#endif /* CONFIG_HCI_UART_TIMESYNC_MODEL */
 
-static void tx_thread(void *p1, void *p2, void *p3)
-{
-	while (1) {
-		struct net_buf *buf;
-		int err;
+#if defined(CONFIG_HCI_UART_ISO_SDU_REPORT)
+/* Unused entry, ISO handles are 12 bit */
+#define ISO_SDU_REPORT_HANDLE_NONE	0xffff
 
-		/* Wait until a buffer is available */
-		buf = k_fifo_get(&tx_queue, K_FOREVER);
-		/* Pass buffer to the stack */
-		err = bt_send(buf);
-        if (err!=BT_HCI_ERR_SUCCESS) {
-            if (err!=BT_HCI_ERR_EXT_HANDLED) {
-                LOG_ERR("Unable to send (err %d)", err);
-            }
-            net_buf_unref(buf);
-        }
+/* Flags of the ISO SDU report */
+#define ISO_SDU_REPORT_FLAGS_TS		0x01	/* SDU timestamp present */
 
-		/* Give other threads a chance to run if tx_queue keeps getting
-		 * new data all the time.
-		 */
-		k_yield();
-	}
-}
+struct hci_cmd_iso_sdu_report {
+	uint16_t handle;
+	/* 1 to report the SDUs of the handle, 0 to stop */
+	uint8_t enable;
+} __packed;
 
-static int h4_send(struct net_buf *buf)
-{
-	LOG_DBG("buf %p type %u len %u", buf, bt_buf_get_type(buf),
-		    buf->len);
+struct hci_evt_vs_iso_sdu {
+	uint8_t subevent;
+	uint16_t handle;
+	uint16_t sequence_number;
+	uint8_t flags;
+	/* Time stamp of the SDU in the ISO clock, 0 if not present */
+	uint32_t sdu_timestamp_us;
+	/* Controller time at which the SDU was queued for the UART */
+	uint64_t controller_us;
+} __packed;
 
-	k_fifo_put(&uart_tx_queue, buf);
-	uart_irq_tx_enable(hci_uart_dev);
+static uint16_t iso_sdu_report_handles[CONFIG_HCI_UART_ISO_SDU_REPORT_MAX_HANDLES] = {
+	[0 ... CONFIG_HCI_UART_ISO_SDU_REPORT_MAX_HANDLES - 1] = ISO_SDU_REPORT_HANDLE_NONE,
+};
 
-	return 0;
+static int iso_sdu_report_find(uint16_t handle)
+{
+	for (int i = 0; i < ARRAY_SIZE(iso_sdu_report_handles); i++) {
+		if (iso_sdu_report_handles[i] == handle) {
+			return i;
+		}
+	}
+
+	return -1;
 }
 
-#if defined(CONFIG_BT_CTLR_ASSERT_HANDLER)
-void bt_ctlr_assert_handle(char *file, uint32_t line)
+/* Called for every packet to the host before it is queued for the UART. For
+ * the first fragment of an SDU on a selected handle, a vendor event with the
+ * controller time is queued along. The SDU is not touched after it has been
+ * queued, as the TX engine may already have sent and freed it. Reports are
+ * dropped if no event buffer is available.
+ */
+static void iso_sdu_report(struct net_buf *buf)
 {
-	uint32_t len = 0U, pos = 0U;
+	/* ISO header follows the H:4 packet type if present */
+	size_t offset = IS_ENABLED(CONFIG_BT_HCI_RAW_H4) ? 1 : 0;
+	const struct bt_hci_iso_sdu_hdr *sdu_hdr;
+	struct hci_evt_vs_iso_sdu *evt;
+	struct bt_hci_evt_hdr *hdr;
+	struct net_buf *rsp;
+	uint32_t sdu_timestamp_us = 0;
+	uint16_t handle;
+	uint8_t flags;
 
-	/* Disable interrupts, this is unrecoverable */
-	(void)irq_lock();
+	if (bt_buf_get_type(buf) != BT_BUF_ISO_IN ||
+	    buf->len < offset + sizeof(struct bt_hci_iso_hdr)) {
+		return;
+	}
 
-	uart_irq_rx_disable(hci_uart_dev);
-	uart_irq_tx_disable(hci_uart_dev);
+	handle = sys_get_le16(&buf->data[offset]);
+	flags = bt_iso_flags(handle);
+	handle = bt_iso_handle(handle);
+	offset += sizeof(struct bt_hci_iso_hdr);
 
-	if (file) {
-		while (file[len] != '\0') {
-			if (file[len] == '/') {
-				pos = len + 1;
-			}
-			len++;
+	/* Only the first fragment carries the SDU header */
+	if (iso_sdu_report_find(handle) < 0 ||
+	    (bt_iso_flags_pb(flags) != BT_ISO_START &&
+	     bt_iso_flags_pb(flags) != BT_ISO_SINGLE)) {
+		return;
+	}
+
+	if (bt_iso_flags_ts(flags)) {
+		if (buf->len < offset + sizeof(uint32_t)) {
+			return;
 		}
-		file += pos;
-		len -= pos;
+		sdu_timestamp_us = sys_get_le32(&buf->data[offset]);
+		offset += sizeof(uint32_t);
 	}
 
-	uart_poll_out(hci_uart_dev, H4_EVT);
-	/* Vendor-Specific debug event */
-	uart_poll_out(hci_uart_dev, 0xff);
-	/* 0xAA + strlen + \0 + 32-bit line number */
-	uart_poll_out(hci_uart_dev, 1 + len + 1 + 4);
-	uart_poll_out(hci_uart_dev, 0xAA);
+	if (buf->len < offset + sizeof(*sdu_hdr)) {
+		return;
+	}
+	sdu_hdr = (const void *)&buf->data[offset];
 
-	if (len) {
-		while (*file != '\0') {
-			uart_poll_out(hci_uart_dev, *file);
-			file++;
-		}
-		uart_poll_out(hci_uart_dev, 0x00);
+	rsp = bt_buf_get_evt(BT_HCI_EVT_VENDOR, true, K_NO_WAIT);
+	if (!rsp) {
+		H4_STATS_ATOMIC_INC(c2h.evt_drops);
+		TRACE(EVT_DROP, HCI_EVT_VS_ISO_SDU, 0);
+		return;
 	}
 
-	uart_poll_out(hci_uart_dev, line >> 0 & 0xff);
-	uart_poll_out(hci_uart_dev, line >> 8 & 0xff);
-	uart_poll_out(hci_uart_dev, line >> 16 & 0xff);
-	uart_poll_out(hci_uart_dev, line >> 24 & 0xff);
+	hdr = net_buf_add(rsp, sizeof(*hdr));
+	hdr->evt = BT_HCI_EVT_VENDOR;
+	hdr->len = sizeof(*evt);
 
-	while (1) {
+	evt = net_buf_add(rsp, sizeof(*evt));
+	evt->subevent = HCI_EVT_VS_ISO_SDU;
+	evt->handle = sys_cpu_to_le16(handle);
+	evt->sequence_number = sdu_hdr->sn;
+	evt->flags = bt_iso_flags_ts(flags) ? ISO_SDU_REPORT_FLAGS_TS : 0;
+	evt->sdu_timestamp_us = sys_cpu_to_le32(sdu_timestamp_us);
+	evt->controller_us = sys_cpu_to_le64(controller_time_us_get());
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
 	}
+
+	/* Queued right before the SDU, the caller starts the TX engine */
+	h4_tx_enqueue(rsp);
 }
-#endif /* CONFIG_BT_CTLR_ASSERT_HANDLER */
 
-static int hci_uart_init(void)
+/* Select an ISO handle for SDU reports */
+uint8_t hci_cmd_iso_sdu_report_cb(struct net_buf *buf)
 {
-	LOG_DBG("");
+	const struct hci_cmd_iso_sdu_report *cmd = (const void *)buf->data;
+	struct bt_hci_evt_cc_status *response;
+	uint16_t handle = bt_iso_handle(sys_le16_to_cpu(cmd->handle));
+	struct net_buf *rsp;
+	int idx = iso_sdu_report_find(handle);
 
-	if (IS_ENABLED(CONFIG_USB_CDC_ACM)) {
-		if (usb_enable(NULL)) {
-			LOG_ERR("Failed to enable USB");
-			return -EINVAL;
+	if (cmd->enable && idx < 0) {
+		idx = iso_sdu_report_find(ISO_SDU_REPORT_HANDLE_NONE);
+		if (idx < 0) {
+			return BT_HCI_ERR_MEM_CAPACITY_EXCEEDED;
 		}
+		iso_sdu_report_handles[idx] = handle;
+	} else if (!cmd->enable && idx >= 0) {
+		iso_sdu_report_handles[idx] = ISO_SDU_REPORT_HANDLE_NONE;
 	}
 
-	if (!device_is_ready(hci_uart_dev)) {
-		LOG_ERR("HCI UART %s is not ready", hci_uart_dev->name);
-		return -EINVAL;
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_ISO_SDU_REPORT),
+					 sizeof(*response));
+	response = net_buf_add(rsp, sizeof(*response));
+	response->status = BT_HCI_ERR_SUCCESS;
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
 	}
 
-	uart_irq_rx_disable(hci_uart_dev);
-	uart_irq_tx_disable(hci_uart_dev);
+	h4_send(rsp);
 
-	uart_irq_callback_set(hci_uart_dev, bt_uart_isr);
+	return BT_HCI_ERR_EXT_HANDLED;
+}
+#endif /* CONFIG_HCI_UART_ISO_SDU_REPORT */
 
-	uart_irq_rx_enable(hci_uart_dev);
+#if defined(CONFIG_HCI_UART_STATS)
+/* Flags of the transport statistics command */
+#define TRANSPORT_STATS_FLAGS_RESET	0x01	/* Reset after reading */
 
-	return 0;
+struct hci_cmd_transport_stats {
+	uint8_t flags;
+} __packed;
+
+struct hci_cmd_transport_stats_response {
+	struct bt_hci_evt_cc_status cc;
+	uint32_t h2c_bytes;
+	uint32_t h2c_packets;
+	uint32_t h2c_alloc_failures;
+	uint32_t h2c_discarded;
+	uint32_t h2c_unknown_type;
+	uint32_t h2c_send_errors;
+	uint32_t h2c_queue_max;
+	uint32_t c2h_bytes;
+	uint32_t c2h_packets;
+	uint32_t c2h_evt_drops;
+	uint32_t c2h_queue_max;
+	uint32_t time_recaptures;
+	uint32_t time_stale_captures;
+} __packed;
+
+/* Controller time capture counters at the last reset. The backends count
+ * since boot.
+ */
+static struct {
+	uint32_t recaptures;
+	uint32_t stale_captures;
+} time_capture_base;
+
+/* Read and optionally reset the transport statistics. A reset can lose an
+ * update that races with it, which is fine for statistics. The current
+ * queue depths are kept, their maxima restart from there.
+ */
+uint8_t hci_cmd_transport_stats_cb(struct net_buf *buf)
+{
+	const struct hci_cmd_transport_stats *cmd = (const void *)buf->data;
+	struct hci_cmd_transport_stats_response *response;
+	struct net_buf *rsp;
+
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_TRANSPORT_STATS),
+					 sizeof(*response));
+	response = net_buf_add(rsp, sizeof(*response));
+	response->cc.status = BT_HCI_ERR_SUCCESS;
+	response->h2c_bytes = sys_cpu_to_le32(h4_stats.h2c.bytes);
+	response->h2c_packets = sys_cpu_to_le32(h4_stats.h2c.packets);
+	response->h2c_alloc_failures = sys_cpu_to_le32(h4_stats.h2c.alloc_failures);
+	response->h2c_discarded = sys_cpu_to_le32(h4_stats.h2c.discarded);
+	response->h2c_unknown_type = sys_cpu_to_le32(h4_stats.h2c.unknown_type);
+	response->h2c_send_errors = sys_cpu_to_le32(h4_stats.h2c.send_errors);
+	response->h2c_queue_max = sys_cpu_to_le32(h4_stats.h2c.queue.depth_max);
+	response->c2h_bytes = sys_cpu_to_le32(h4_stats.c2h.bytes);
+	response->c2h_packets = sys_cpu_to_le32(h4_stats.c2h.packets);
+	response->c2h_evt_drops = sys_cpu_to_le32(atomic_get(&h4_stats.c2h.evt_drops));
+	response->c2h_queue_max = sys_cpu_to_le32(h4_stats.c2h.queue.depth_max);
+	response->time_recaptures = sys_cpu_to_le32(controller_time_recapture_count_get() -
+						    time_capture_base.recaptures);
+	response->time_stale_captures = sys_cpu_to_le32(controller_time_stale_capture_count_get() -
+							time_capture_base.stale_captures);
+
+	if (cmd->flags & TRANSPORT_STATS_FLAGS_RESET) {
+		h4_stats.h2c.bytes = 0;
+		h4_stats.h2c.packets = 0;
+		h4_stats.h2c.alloc_failures = 0;
+		h4_stats.h2c.discarded = 0;
+		h4_stats.h2c.unknown_type = 0;
+		h4_stats.h2c.send_errors = 0;
+		h4_stats.h2c.queue.depth_max = h4_stats_queue_depth(&h4_stats.h2c.queue);
+		h4_stats.c2h.bytes = 0;
+		h4_stats.c2h.packets = 0;
+		atomic_clear(&h4_stats.c2h.evt_drops);
+		h4_stats.c2h.queue.depth_max = h4_stats_queue_depth(&h4_stats.c2h.queue);
+		time_capture_base.recaptures = controller_time_recapture_count_get();
+		time_capture_base.stale_captures = controller_time_stale_capture_count_get();
+	}
+
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
+	}
+
+	h4_send(rsp);
+
+	return BT_HCI_ERR_EXT_HANDLED;
 }
+#endif /* CONFIG_HCI_UART_STATS */
 
-SYS_INIT(hci_uart_init, APPLICATION, CONFIG_KERNEL_INIT_PRIORITY_DEVICE);
+#if defined(CONFIG_HCI_UART_BENCH)
+struct hci_cmd_transport_bench {
+	uint8_t mode;
+} __packed;
 
-#define ENABLE_ISO_TIMESYNC
+/* Select where ACL and ISO data from the host goes, see bench_handle() */
+uint8_t hci_cmd_transport_bench_cb(struct net_buf *buf)
+{
+	const struct hci_cmd_transport_bench *cmd = (const void *)buf->data;
+	struct bt_hci_evt_cc_status *cc;
+	struct net_buf *rsp;
 
-#ifdef ENABLE_ISO_TIMESYNC
+	if (cmd->mode > TRANSPORT_BENCH_CONTROLLER) {
+		return BT_HCI_ERR_INVALID_PARAM;
+	}
 
-#define TIMESYNC_GPIO  DT_NODELABEL(timesync)
+	atomic_set(&bench_mode, cmd->mode);
 
-#if DT_NODE_HAS_STATUS(TIMESYNC_GPIO, okay)
-static const struct gpio_dt_spec timesync_pin = GPIO_DT_SPEC_GET(TIMESYNC_GPIO, gpios);
-#else
-#error "No timesync gpio available!"
-#endif
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_TRANSPORT_BENCH),
+					 sizeof(*cc));
+	cc = net_buf_add(rsp, sizeof(*cc));
+	cc->status = BT_HCI_ERR_SUCCESS;
 
-#define  HCI_CMD_ISO_TIMESYNC	(0x200)
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
+	}
 
-struct hci_cmd_iso_timestamp_response {
-    struct bt_hci_evt_cc_status cc;
-    uint32_t timestamp;
+	h4_send(rsp);
+
+	return BT_HCI_ERR_EXT_HANDLED;
+}
+#endif /* CONFIG_HCI_UART_BENCH */
+
+#if defined(CONFIG_HCI_UART_PROF)
+/* Flags of the profile command */
+#define PROFILE_FLAGS_RESET	0x01	/* Reset after reading */
+
+struct hci_cmd_profile {
+	uint8_t point;
+	uint8_t flags;
 } __packed;
 
-uint8_t hci_cmd_iso_timesync_cb(struct net_buf *buf)
+struct hci_cmd_profile_response {
+	struct bt_hci_evt_cc_status cc;
+	uint8_t point;
+	uint32_t cycles_per_sec;
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PROF_HIST_BINS];
+} __packed;
+
+/* Read and optionally reset the cycle statistics of one profiling point.
+ * The values are copied while the point may be updated, so they can be
+ * slightly inconsistent with each other.
+ */
+uint8_t hci_cmd_profile_cb(struct net_buf *buf)
 {
+	const struct hci_cmd_profile *cmd = (const void *)buf->data;
+	const struct prof_stats *stats;
+	struct hci_cmd_profile_response *response;
 	struct net_buf *rsp;
-    struct hci_cmd_iso_timestamp_response *response;
 
-	LOG_INF("buf %p type %u len %u", buf, bt_buf_get_type(buf), buf->len);
-	LOG_INF("buf[0] = 0x%02x", buf->data[0]);
+	if (cmd->point >= PROF_POINT_COUNT) {
+		return BT_HCI_ERR_INVALID_PARAM;
+	}
 
-	uint32_t timestamp_second_us = 0;
+	stats = &prof_block[cmd->point];
 
-	// Lock interrupts to avoid interrupt between time capture and gpio toggle
-	uint32_t key = arch_irq_lock();
-
-#ifdef CONFIG_SOC_NRF5340_CPUAPP
-	// Get current time
-	uint32_t timestamp_first_us = audio_sync_timer_capture();
-
-	while (1){
-		// get time again and verify that time didn't jump. Work around:
-		// https://devzone.nordicsemi.com/f/nordic-q-a/116907/bluetooth-netcore-time-capture-not-working-100-for-le-audio
-		timestamp_second_us = audio_sync_timer_capture();
-		int32_t timestamp_delta = (int32_t) (timestamp_second_us - timestamp_first_us);
-		if (timestamp_delta < 10){
-			break;
-		}
-		timestamp_first_us = timestamp_second_us;
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_PROFILE),
+					 sizeof(*response));
+	response = net_buf_add(rsp, sizeof(*response));
+	response->cc.status = BT_HCI_ERR_SUCCESS;
+	response->point = cmd->point;
+	response->cycles_per_sec = sys_cpu_to_le32(prof_cycles_per_sec());
+	response->count = sys_cpu_to_le32(stats->count);
+	response->min = sys_cpu_to_le32(stats->count ? stats->min : 0);
+	response->max = sys_cpu_to_le32(stats->max);
+	response->sum = sys_cpu_to_le64(stats->sum);
+	for (int i = 0; i < PROF_HIST_BINS; i++) {
+		response->hist[i] = sys_cpu_to_le32(stats->hist[i]);
 	}
-#endif
 
-#if defined(CONFIG_SOC_NRF54L15_CPUAPP) || defined(CONFIG_SOC_NRF52833)
-	timestamp_second_us = (uint32_t) controller_time_us_get();
-#endif
+	if (cmd->flags & PROFILE_FLAGS_RESET) {
+		prof_reset(cmd->point);
+	}
 
-#if DT_NODE_HAS_STATUS(TIMESYNC_GPIO, okay)
-	gpio_pin_toggle_dt( &timesync_pin );
-#endif
+	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
+		net_buf_push_u8(rsp, H4_EVT);
+	}
 
-	// Unlock interrupts
-	arch_irq_unlock(key);
+	h4_send(rsp);
 
-	// emit event
-	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC), sizeof(*response));
+	return BT_HCI_ERR_EXT_HANDLED;
+}
+#endif /* CONFIG_HCI_UART_PROF */
+
+#if defined(CONFIG_HCI_UART_TRACE)
+/* Flags of the trace read command */
+#define TRACE_READ_FLAGS_STOP	0x01	/* Stop recording before reading */
+#define TRACE_READ_FLAGS_START	0x02	/* Restart recording after reading */
+
+/* Records that fit into a Command Complete event */
+#define TRACE_READ_MAX		14
+
+struct hci_cmd_trace_read {
+	uint8_t flags;
+	uint32_t index;
+} __packed;
+
+struct hci_cmd_trace_read_response {
+	struct bt_hci_evt_cc_status cc;
+	uint32_t next;
+	uint32_t head;
+	uint8_t count;
+	/* See trace_anchor_get() */
+	uint32_t cycles_per_sec;
+	uint32_t anchor_cycles;
+	uint64_t anchor_us;
+	/* Records as struct trace_record, little endian */
+	uint8_t records[];
+} __packed;
+
+/* Read trace records from the given index on. Indexes that have been
+ * overwritten already continue at the oldest record. Records being written
+ * are skipped, the host continues at next.
+ */
+uint8_t hci_cmd_trace_read_cb(struct net_buf *buf)
+{
+	const struct hci_cmd_trace_read *cmd = (const void *)buf->data;
+	struct hci_cmd_trace_read_response *response;
+	struct trace_record record;
+	struct net_buf *rsp;
+	uint32_t index = sys_le32_to_cpu(cmd->index);
+	uint32_t cycles_per_sec;
+	uint32_t anchor_cycles;
+	uint64_t anchor_us;
+	uint32_t head;
+
+	if (cmd->flags & TRACE_READ_FLAGS_STOP) {
+		trace_enable(false);
+	}
+
+	head = trace_head_get();
+	if ((int32_t)(head - index) > TRACE_RECORDS) {
+		index = head - TRACE_RECORDS;
+	} else if ((int32_t)(head - index) < 0) {
+		index = head;
+	}
+
+	rsp = bt_hci_cmd_complete_create(BT_OP(BT_OGF_VS, HCI_CMD_TRACE_READ),
+					 sizeof(*response) +
+					 TRACE_READ_MAX * sizeof(struct trace_record));
 	response = net_buf_add(rsp, sizeof(*response));
 	response->cc.status = BT_HCI_ERR_SUCCESS;
-	response->timestamp = timestamp_second_us;
+	response->count = 0;
+	trace_anchor_get(&cycles_per_sec, &anchor_cycles, &anchor_us);
+	response->cycles_per_sec = sys_cpu_to_le32(cycles_per_sec);
+	response->anchor_cycles = sys_cpu_to_le32(anchor_cycles);
+	response->anchor_us = sys_cpu_to_le64(anchor_us);
+
+	while (index != head && response->count < TRACE_READ_MAX) {
+		if (trace_read(index, &record)) {
+			net_buf_add_le32(rsp, record.seq);
+			net_buf_add_le32(rsp, record.cycles);
+			net_buf_add_le16(rsp, record.event);
+			net_buf_add_le16(rsp, record.arg0);
+			net_buf_add_le32(rsp, record.arg1);
+			response->count++;
+		}
+		index++;
+	}
+
+	response->next = sys_cpu_to_le32(index);
+	response->head = sys_cpu_to_le32(head);
+
+	if (cmd->flags & TRACE_READ_FLAGS_START) {
+		trace_enable(true);
+	}
 
 	if (IS_ENABLED(CONFIG_BT_HCI_RAW_H4)) {
 		net_buf_push_u8(rsp, H4_EVT);
 	}
 
-    h4_send( rsp );
+	h4_send(rsp);
 
 	return BT_HCI_ERR_EXT_HANDLED;
 }
+#endif /* CONFIG_HCI_UART_TRACE */
 #endif
 
 int main(void)
 {
+#if !defined(CONFIG_HCI_UART_TX_DIRECT)
 	/* incoming events and data from the controller */
 	static K_FIFO_DEFINE(rx_queue);
 	int err;
+#endif
 
 	LOG_DBG("Start");
 	__ASSERT(hci_uart_dev, "UART device is NULL");
@@ -479,17 +2493,86 @@ int main(void)
 
 #ifdef ENABLE_ISO_TIMESYNC
 	/* Register iso_timesync command */
-	static struct bt_hci_raw_cmd_ext cmd_list = {
-	    .op = BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC),
-		.min_len = 1,
-		.func = hci_cmd_iso_timesync_cb
+	static struct bt_hci_raw_cmd_ext cmd_list[] = {
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC),
+			.min_len = 1,
+			.func = hci_cmd_iso_timesync_cb
+		},
+#if defined(CONFIG_HCI_UART_TIMESYNC_HW_PULSE)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC_SCHEDULE),
+			.min_len = sizeof(struct hci_cmd_iso_timesync_schedule),
+			.func = hci_cmd_iso_timesync_schedule_cb
+		},
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC_TRAIN),
+			.min_len = sizeof(struct hci_cmd_iso_timesync_train),
+			.func = hci_cmd_iso_timesync_train_cb
+		},
+#endif
+#if defined(CONFIG_HCI_UART_TIMESYNC_MODEL)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_ISO_TIMESYNC_MODEL),
+			.min_len = sizeof(struct hci_cmd_iso_timesync_model),
+			.func = hci_cmd_iso_timesync_model_cb
+		},
+#endif
+#if defined(CONFIG_HCI_UART_ISO_SDU_REPORT)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_ISO_SDU_REPORT),
+			.min_len = sizeof(struct hci_cmd_iso_sdu_report),
+			.func = hci_cmd_iso_sdu_report_cb
+		},
+#endif
+#if defined(CONFIG_HCI_UART_STATS)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_TRANSPORT_STATS),
+			.min_len = sizeof(struct hci_cmd_transport_stats),
+			.func = hci_cmd_transport_stats_cb
+		},
+#endif
+#if defined(CONFIG_HCI_UART_BENCH)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_TRANSPORT_BENCH),
+			.min_len = sizeof(struct hci_cmd_transport_bench),
+			.func = hci_cmd_transport_bench_cb
+		},
+#endif
+#if defined(CONFIG_HCI_UART_PROF)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_PROFILE),
+			.min_len = sizeof(struct hci_cmd_profile),
+			.func = hci_cmd_profile_cb
+		},
+#endif
+#if defined(CONFIG_HCI_UART_TRACE)
+		{
+			.op = BT_OP(BT_OGF_VS, HCI_CMD_TRACE_READ),
+			.min_len = sizeof(struct hci_cmd_trace_read),
+			.func = hci_cmd_trace_read_cb
+		},
+#endif
 	};
 
 #if DT_NODE_HAS_STATUS(TIMESYNC_GPIO, okay)
 	gpio_pin_configure_dt(&timesync_pin, GPIO_OUTPUT_INACTIVE);
 #endif
 
-	bt_hci_raw_cmd_ext_register(&cmd_list, 1);
+#if defined(CONFIG_HCI_UART_TIMESYNC_HW_PULSE)
+	if (timesync_pulse_init()) {
+		LOG_WRN("Unable to set up timesync pulse, toggling by GPIO");
+		gpio_pin_configure_dt(&timesync_pin, GPIO_OUTPUT_INACTIVE);
+	} else {
+		timesync_hw_pulse = true;
+	}
+#endif
+
+	timesync_rsp_prealloc();
+	bt_hci_raw_cmd_ext_register(cmd_list, ARRAY_SIZE(cmd_list));
+
+	LOG_INF("Controller time resolution %u ns, capture %u ns",
+		controller_time_resolution_ns(), controller_time_capture_cost_ns());
 #endif
 
 	/* Spawn the TX thread and start feeding commands and data to the
@@ -510,6 +2593,20 @@ int main(void)
     return 0;
 #endif
 
+#if defined(CONFIG_HCI_UART_TX_DIRECT)
+	/* The TX engine takes packets from rx_queue itself while it is
+	 * running. Only start it when it went idle and new packets arrived.
+	 */
+	struct k_poll_event rx_queue_evt = K_POLL_EVENT_INITIALIZER(
+		K_POLL_TYPE_FIFO_DATA_AVAILABLE, K_POLL_MODE_NOTIFY_ONLY, &rx_queue);
+
+	while (1) {
+		rx_queue_evt.state = K_POLL_STATE_NOT_READY;
+		k_poll(&rx_queue_evt, 1, K_FOREVER);
+		h4_tx_kick();
+		k_sem_take(&tx_idle_sem, K_FOREVER);
+	}
+#else
     while (1) {
 		struct net_buf *buf;
 
@@ -519,5 +2616,6 @@ int main(void)
 			LOG_ERR("Failed to send");
 		}
 	}
+#endif
 	return 0;
 }
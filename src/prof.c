@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file keeps cycle statistics of the UART hot paths
+ *
+ * The DWT cycle counter is used where the CPU has one, it counts CPU clock
+ * cycles and costs a single register read. Elsewhere, e.g. on native_sim,
+ * the system cycle counter is used instead.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include "prof.h"
+
+struct prof_stats prof_block[PROF_POINT_COUNT];
+uint32_t prof_mark[PROF_POINT_COUNT];
+
+void prof_reset(enum prof_point point)
+{
+	memset(&prof_block[point], 0, sizeof(prof_block[point]));
+	prof_block[point].min = UINT32_MAX;
+}
+
+int prof_init(void)
+{
+	for (int point = 0; point < PROF_POINT_COUNT; point++) {
+		prof_reset(point);
+	}
+
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#if defined(CONFIG_ARMV8_M_MAINLINE)
+	DCB->DEMCR |= DCB_DEMCR_TRCENA_Msk;
+#else
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#endif
+	if (DWT->CTRL & DWT_CTRL_NOCYCCNT_Msk) {
+		return -ENOTSUP;
+	}
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+	return 0;
+}
+
+uint32_t prof_cycles_per_sec(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+	return SystemCoreClock;
+#else
+	return sys_clock_hw_cycles_per_sec();
+#endif
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef PROF_H__
+#define PROF_H__
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#include <cmsis_core.h>
+#endif
+
+enum prof_point {
+	/* rx_isr(), or UART_RX_RDY handling with the async API */
+	PROF_RX_ISR,
+	/* tx_isr(), or UART_TX_DONE handling with the async API */
+	PROF_TX_ISR,
+	/* bt_send() in the TX thread, including vendor command handlers */
+	PROF_BT_SEND,
+	/* Section of the timesync command with IRQs locked */
+	PROF_TIMESYNC_LOCKED,
+	/* Timesync command from bt_send() until the response is passed to h4_send() */
+	PROF_TIMESYNC_RESPONSE,
+	/* trace_write(), from any context */
+	PROF_TRACE_WRITE,
+	PROF_POINT_COUNT,
+};
+
+/* Bin i counts durations of 2^i to 2^(i+1) - 1 cycles, the last one all above */
+#define PROF_HIST_BINS 16
+
+struct prof_stats {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t hist[PROF_HIST_BINS];
+};
+
+#if defined(CONFIG_HCI_UART_PROF)
+/* Fixed RAM block, can also be read by the debugger while running */
+extern struct prof_stats prof_block[PROF_POINT_COUNT];
+
+/* Start cycles of points that end in another function, see PROF_MARK() */
+extern uint32_t prof_mark[PROF_POINT_COUNT];
+
+/** @brief Start the cycle counter and clear all statistics.
+ *
+ * @return 0 on success, -ENOTSUP if the DWT has no cycle counter.
+ */
+int prof_init(void);
+
+/** @brief Clear the statistics of one point. */
+void prof_reset(enum prof_point point);
+
+/** @brief Frequency of prof_cycles(). */
+uint32_t prof_cycles_per_sec(void);
+
+static inline uint32_t prof_cycles(void)
+{
+#if defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+	return DWT->CYCCNT;
+#else
+	return k_cycle_get_32();
+#endif
+}
+
+/* Each point is recorded from one context only, so no locking is needed */
+static inline void prof_record(enum prof_point point, uint32_t cycles)
+{
+	struct prof_stats *stats = &prof_block[point];
+	uint32_t bin = cycles ? 31 - __builtin_clz(cycles) : 0;
+
+	stats->count++;
+	stats->sum += cycles;
+	if (cycles < stats->min) {
+		stats->min = cycles;
+	}
+	if (cycles > stats->max) {
+		stats->max = cycles;
+	}
+	stats->hist[MIN(bin, PROF_HIST_BINS - 1)]++;
+}
+
+#define PROF_START(point) uint32_t prof_start_##point = prof_cycles()
+#define PROF_STOP(point) prof_record(PROF_##point, prof_cycles() - prof_start_##point)
+
+/* Like PROF_START() and PROF_STOP(), for a point that starts in one function
+ * and ends in a callee, e.g. in a command handler called by bt_send(). A mark
+ * without a stop is overwritten by the next one.
+ */
+#define PROF_MARK(point) (prof_mark[PROF_##point] = prof_cycles())
+#define PROF_STOP_MARK(point) \
+	prof_record(PROF_##point, prof_cycles() - prof_mark[PROF_##point])
+
+/* Like PROF_STOP(), for a point that is recorded from several contexts */
+#define PROF_STOP_LOCKED(point)						\
+	do {								\
+		uint32_t prof_delta = prof_cycles() - prof_start_##point;	\
+		unsigned int prof_key = irq_lock();			\
+									\
+		prof_record(PROF_##point, prof_delta);			\
+		irq_unlock(prof_key);					\
+	} while (0)
+#else
+#define PROF_START(point)
+#define PROF_STOP(point)
+#define PROF_MARK(point)
+#define PROF_STOP_MARK(point)
+#define PROF_STOP_LOCKED(point)
+#endif /* CONFIG_HCI_UART_PROF */
+
+#endif
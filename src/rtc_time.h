@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** Conversions between 32768 Hz RTC ticks and microseconds
+ *
+ * One RTC tick is 30517578125 fs, i.e. exactly 15625 / 512 us. Both directions
+ * are computed with multiplications and shifts only, so no 64-bit division
+ * (__aeabi_uldivmod on Cortex-M) is needed. The results are bit-identical to
+ *   (ticks * 30517578125) / 1000000000 and
+ *   (us * 1000000000) / 30517578125
+ * for all 32-bit inputs where the former does not overflow.
+ */
+
+#ifndef RTC_TIME_H__
+#define RTC_TIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* RTC tick in us as fraction 15625 / 2^9 */
+#define RTC_TIME_US_PER_TICK_NUM	15625U
+#define RTC_TIME_US_PER_TICK_SHIFT	9
+
+/* Reciprocal 512 / 15625 as ceil(2^45 * 512 / 15625), exact for all 32-bit
+ * inputs. Split in high and low word to need 32x32 bit multiplications only.
+ */
+#define RTC_TIME_TICKS_PER_US_MUL_HI	0x10CU
+#define RTC_TIME_TICKS_PER_US_MUL_LO	0x6F7A0B5FU
+#define RTC_TIME_TICKS_PER_US_SHIFT	45
+
+/** @brief Convert RTC ticks to microseconds, rounded down. */
+static inline uint64_t rtc_time_ticks_to_us(uint32_t rtc_ticks)
+{
+	return ((uint64_t)rtc_ticks * RTC_TIME_US_PER_TICK_NUM) >> RTC_TIME_US_PER_TICK_SHIFT;
+}
+
+/** @brief Convert microseconds to RTC ticks, rounded down. */
+static inline uint32_t rtc_time_us_to_ticks(uint32_t timestamp_us)
+{
+	uint64_t product_shifted_32 =
+		(((uint64_t)timestamp_us * RTC_TIME_TICKS_PER_US_MUL_LO) >> 32) +
+		(uint64_t)timestamp_us * RTC_TIME_TICKS_PER_US_MUL_HI;
+
+	return product_shifted_32 >> (RTC_TIME_TICKS_PER_US_SHIFT - 32);
+}
+
+/* Half of the 24-bit RTC counter range */
+#define RTC_TIME_COUNTER_HALF		(1UL << 23)
+
+/** @brief Count a pending RTC overflow and get the overflows that belong to a
+ * counter value.
+ *
+ * The OVRFLW event is counted by whoever sees it first, the overflow ISR or a
+ * reader of the time, and cleared by it. Both check, clear and count with IRQs
+ * locked, so each overflow is counted exactly once, also when the reader
+ * preempts the ISR, runs with IRQs locked or in an ISR of higher priority.
+ *
+ * A pending overflow belongs to the counter value only if that was read after
+ * the wrap, i.e. is in the lower half of the range.
+ *
+ * @param num_overflows    In: overflows counted so far. Out: including a
+ *                         pending one.
+ * @param rtc_ticks        RTC counter value, read before the event.
+ * @param overflow_pending OVRFLW event state. The caller clears the event if
+ *                         it is set.
+ *
+ * @return Number of overflows to combine with rtc_ticks.
+ */
+static inline uint32_t rtc_time_overflows_get(uint32_t *num_overflows, uint32_t rtc_ticks,
+					      bool overflow_pending)
+{
+	if (!overflow_pending) {
+		return *num_overflows;
+	}
+
+	(*num_overflows)++;
+
+	return rtc_ticks < RTC_TIME_COUNTER_HALF ? *num_overflows : *num_overflows - 1;
+}
+
+#endif
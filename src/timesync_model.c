@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file fits controller time against a host reference time
+ *
+ * Least squares line through the offsets (controller minus host time) over
+ * host time, for the last TIMESYNC_MODEL_SAMPLES samples. Deviations from
+ * the means are kept scaled by the number of samples, so the sums are exact
+ * integers and no precision is lost to rounded means.
+ */
+
+#include <string.h>
+#include "timesync_model.h"
+
+/* Offsets changing by more than this within the window are not plausible */
+#define OFFSET_DELTA_MAX_US (1 << 30)
+
+/* Deviations are saturated to this before squaring to keep the sum in range */
+#define RESIDUAL_MAX_NS 1000000000LL
+
+/* Divisor bits that allow to multiply the remainder by 10^6 in 64 bits */
+#define SKEW_DIVISOR_BITS 43
+
+static int32_t offset_delta_us(int64_t offset_us, int64_t ref_us)
+{
+	int64_t delta = offset_us - ref_us;
+
+	if (delta > OFFSET_DELTA_MAX_US) {
+		return OFFSET_DELTA_MAX_US;
+	}
+	if (delta < -OFFSET_DELTA_MAX_US) {
+		return -OFFSET_DELTA_MAX_US;
+	}
+
+	return delta;
+}
+
+static uint32_t sqrt_u64(uint64_t value)
+{
+	uint64_t root = 0;
+	uint64_t bit = 1ULL << 62;
+
+	while (bit > value) {
+		bit >>= 2;
+	}
+
+	while (bit) {
+		if (value >= root + bit) {
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		} else {
+			root >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return root;
+}
+
+/* Skew in ppb from the slope sxy / sxx in microseconds per millisecond */
+static int32_t skew_ppb_get(int64_t sxy, int64_t sxx)
+{
+	int64_t whole = sxy / sxx;
+	int64_t rem = sxy % sxx;
+	int64_t ppb;
+
+	while (sxx >= (1LL << SKEW_DIVISOR_BITS)) {
+		sxx >>= 1;
+		rem /= 2;
+	}
+
+	ppb = whole * 1000000 + rem * 1000000 / sxx;
+
+	if (ppb > INT32_MAX) {
+		return INT32_MAX;
+	}
+	if (ppb < INT32_MIN) {
+		return INT32_MIN;
+	}
+
+	return ppb;
+}
+
+void timesync_model_reset(struct timesync_model *model)
+{
+	memset(model, 0, sizeof(*model));
+}
+
+void timesync_model_add(struct timesync_model *model, uint64_t host_us,
+			uint64_t controller_us)
+{
+	if (model->count) {
+		const struct timesync_model_sample *newest =
+			&model->samples[(model->next + TIMESYNC_MODEL_SAMPLES - 1) %
+					TIMESYNC_MODEL_SAMPLES];
+
+		if (host_us <= newest->host_us) {
+			timesync_model_reset(model);
+		}
+	}
+
+	model->samples[model->next].host_us = host_us;
+	model->samples[model->next].offset_us = (int64_t)(controller_us - host_us);
+	model->next = (model->next + 1) % TIMESYNC_MODEL_SAMPLES;
+	if (model->count < TIMESYNC_MODEL_SAMPLES) {
+		model->count++;
+	}
+}
+
+void timesync_model_fit(const struct timesync_model *model,
+			struct timesync_model_fit *fit)
+{
+	const struct timesync_model_sample *newest;
+	int32_t x[TIMESYNC_MODEL_SAMPLES];
+	int32_t y[TIMESYNC_MODEL_SAMPLES];
+	int64_t n = model->count;
+	int64_t sx = 0;
+	int64_t sy = 0;
+	int64_t sxx = 0;
+	int64_t sxy = 0;
+	uint64_t srr = 0;
+	int64_t offset_rel_ns;
+
+	memset(fit, 0, sizeof(*fit));
+	fit->samples = model->count;
+	if (!model->count) {
+		return;
+	}
+
+	newest = &model->samples[(model->next + TIMESYNC_MODEL_SAMPLES - 1) %
+				 TIMESYNC_MODEL_SAMPLES];
+
+	/* Host time in ms and offset in us, relative to the newest sample */
+	for (int i = 0; i < n; i++) {
+		const struct timesync_model_sample *s = &model->samples[i];
+
+		x[i] = (int64_t)(s->host_us - newest->host_us) / 1000;
+		y[i] = offset_delta_us(s->offset_us, newest->offset_us);
+		sx += x[i];
+		sy += y[i];
+	}
+
+	/* Deviations from the means, scaled by n */
+	for (int i = 0; i < n; i++) {
+		int64_t dx = n * x[i] - sx;
+		int64_t dy = n * y[i] - sy;
+
+		sxx += dx * dx;
+		sxy += dx * dy;
+	}
+
+	if (sxx) {
+		fit->skew_ppb = skew_ppb_get(sxy, sxx);
+	}
+
+	/* Line through the means: offset at x = 0 relative to the newest one */
+	offset_rel_ns = (sy * 1000 - (int64_t)fit->skew_ppb * sx / 1000) / n;
+	fit->offset_ns = newest->offset_us * 1000 + offset_rel_ns;
+
+	for (int i = 0; i < n; i++) {
+		int64_t r = (int64_t)y[i] * 1000 -
+			    (offset_rel_ns + (int64_t)fit->skew_ppb * x[i] / 1000);
+
+		r = r > RESIDUAL_MAX_NS ? RESIDUAL_MAX_NS : r;
+		r = r < -RESIDUAL_MAX_NS ? -RESIDUAL_MAX_NS : r;
+		srr += r * r;
+	}
+
+	fit->residual_ns = sqrt_u64(srr / n);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TIMESYNC_MODEL_H__
+#define TIMESYNC_MODEL_H__
+
+#include <stdint.h>
+
+#define TIMESYNC_MODEL_SAMPLES CONFIG_HCI_UART_TIMESYNC_MODEL_SAMPLES
+
+/* Pair of host reference time and controller time */
+struct timesync_model_sample {
+	uint64_t host_us;
+	/* Controller time minus host time */
+	int64_t offset_us;
+};
+
+/* Ring of the most recent samples */
+struct timesync_model {
+	struct timesync_model_sample samples[TIMESYNC_MODEL_SAMPLES];
+	uint8_t count;
+	uint8_t next;
+};
+
+struct timesync_model_fit {
+	/* Controller time minus host time at the most recent sample */
+	int64_t offset_ns;
+	/* Controller clock rate relative to the host clock, minus one */
+	int32_t skew_ppb;
+	/* RMS deviation of the samples from the fitted line */
+	uint32_t residual_ns;
+	uint8_t samples;
+};
+
+/** @brief Drop all samples. */
+void timesync_model_reset(struct timesync_model *model);
+
+/** @brief Add a sample, replacing the oldest one if the ring is full.
+ *
+ * A host time that does not advance restarts the model, e.g. after the
+ * host clock has been stepped.
+ */
+void timesync_model_add(struct timesync_model *model, uint64_t host_us,
+			uint64_t controller_us);
+
+/** @brief Fit offset and skew to the samples by least squares.
+ *
+ * Uses 64-bit integer arithmetic only. Host times are taken in milliseconds
+ * relative to the most recent sample, which is precise enough as they are
+ * multiplied by the skew only. The window may span up to about 15 minutes.
+ */
+void timesync_model_fit(const struct timesync_model *model,
+			struct timesync_model_fit *fit);
+
+#endif
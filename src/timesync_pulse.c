@@ -0,0 +1,204 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file toggles the timesync pin by hardware
+ *
+ * The pin is driven by a GPIOTE task, which is triggered by the controller
+ * time trigger event through (D)PPI for scheduled edges, and by the CPU for
+ * immediate ones.
+ */
+
+// BK: based on ncs/nrf/samples/bluetooth/conn_time_sync/src/timed_led_toggle.c
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <nrfx_gpiote.h>
+#include <helpers/nrfx_gppi.h>
+#include <soc.h>
+#include "controller_time.h"
+#include "timesync_pulse.h"
+
+#define TIMESYNC_GPIO DT_NODELABEL(timesync)
+
+/* The trigger must be set up a few RTC ticks ahead */
+#define TIMESYNC_PULSE_MIN_LEAD_US 200
+/* Half of the 512 s RTC range, to never compare against a past tick */
+#define TIMESYNC_PULSE_MAX_LEAD_US 256000000ULL
+
+#define TIMESYNC_PULSE_MIN_PERIOD_US 1000
+
+static const nrfx_gpiote_t gpiote =
+	NRFX_GPIOTE_INSTANCE(NRF_DT_GPIOTE_INST(TIMESYNC_GPIO, gpios));
+static const uint32_t timesync_pin = NRF_DT_GPIOS_TO_PSEL(TIMESYNC_GPIO, gpios);
+
+static void train_timer_handler(struct k_timer *timer);
+static K_TIMER_DEFINE(train_timer, train_timer_handler, NULL);
+
+static struct {
+	timesync_pulse_edge_cb_t cb;
+	/* Controller time of edge 0, edge n is n periods later */
+	uint64_t start_us;
+	uint64_t armed_us;
+	uint32_t period_us;
+	uint32_t edge;
+	bool active;
+} train;
+
+int timesync_pulse_init(void)
+{
+	int ret;
+	uint8_t gpiote_channel;
+	uint8_t ppi_chan_gpiote_toggle;
+
+	if (!controller_time_trigger_supported()) {
+		return -ENOTSUP;
+	}
+
+	ret = nrfx_gpiote_channel_alloc(&gpiote, &gpiote_channel);
+	if (ret != NRFX_SUCCESS) {
+		printk("Failed allocating GPIOTE channel (ret: %d)\n", ret - NRFX_ERROR_BASE_NUM);
+		return -ENODEV;
+	}
+
+	const nrfx_gpiote_output_config_t output_cfg = {
+		.drive = NRF_GPIO_PIN_S0S1,
+		.input_connect = NRF_GPIO_PIN_INPUT_DISCONNECT,
+		.pull = NRF_GPIO_PIN_NOPULL,
+	};
+	const nrfx_gpiote_task_config_t task_cfg = {
+		.task_ch = gpiote_channel,
+		.polarity = NRF_GPIOTE_POLARITY_TOGGLE,
+		.init_val = NRF_GPIOTE_INITIAL_VALUE_LOW,
+	};
+
+	ret = nrfx_gpiote_output_configure(&gpiote, timesync_pin, &output_cfg, &task_cfg);
+	if (ret != NRFX_SUCCESS) {
+		printk("Failed configuring timesync pin (ret: %d)\n", ret - NRFX_ERROR_BASE_NUM);
+		nrfx_gpiote_channel_free(&gpiote, gpiote_channel);
+		return -ENODEV;
+	}
+
+	nrfx_gpiote_out_task_enable(&gpiote, timesync_pin);
+
+	if (nrfx_gppi_channel_alloc(&ppi_chan_gpiote_toggle) != NRFX_SUCCESS) {
+		printk("Failed allocating for timesync pin toggle\n");
+		/* Release the pin, so that it can be toggled by GPIO instead */
+		nrfx_gpiote_out_task_disable(&gpiote, timesync_pin);
+		nrfx_gpiote_pin_uninit(&gpiote, timesync_pin);
+		nrfx_gpiote_channel_free(&gpiote, gpiote_channel);
+		return -ENOMEM;
+	}
+
+	nrfx_gppi_channel_endpoints_setup(ppi_chan_gpiote_toggle,
+					  controller_time_trigger_event_addr_get(),
+					  nrfx_gpiote_out_task_address_get(&gpiote, timesync_pin));
+
+	nrfx_gppi_channels_enable(BIT(ppi_chan_gpiote_toggle));
+
+	return 0;
+}
+
+void timesync_pulse_toggle(void)
+{
+	nrfx_gpiote_out_task_trigger(&gpiote, timesync_pin);
+}
+
+int timesync_pulse_schedule(uint64_t *timestamp_us)
+{
+	uint64_t now_us = controller_time_us_get();
+
+	if (*timestamp_us < now_us + TIMESYNC_PULSE_MIN_LEAD_US ||
+	    *timestamp_us > now_us + TIMESYNC_PULSE_MAX_LEAD_US) {
+		return -EINVAL;
+	}
+
+	*timestamp_us = controller_time_trigger_set(*timestamp_us);
+
+	return 0;
+}
+
+/* The timer is one-shot and re-armed from controller time on every run. A
+ * periodic kernel timer rounds the period to kernel ticks and would drift
+ * against the grid until edges are armed in the past.
+ */
+static void train_timer_arm(uint64_t now_us)
+{
+	k_timer_start(&train_timer, K_USEC(train.armed_us + train.period_us / 2 - now_us),
+		      K_NO_WAIT);
+}
+
+/* Runs half a period after each edge: arm the next edge, then report the
+ * previous one. Grid edges that are too close or already past when the
+ * handler runs late are skipped, the reported edge numbers show the gap.
+ */
+static void train_timer_handler(struct k_timer *timer)
+{
+	uint64_t now_us = controller_time_us_get();
+	uint64_t edge_us = train.armed_us;
+	uint32_t edge = train.edge;
+	uint64_t next_us;
+
+	ARG_UNUSED(timer);
+
+	/* The armed edge has not happened yet, come back after it */
+	if (now_us < edge_us) {
+		train_timer_arm(now_us);
+		return;
+	}
+
+	train.edge++;
+	next_us = train.start_us + (uint64_t)train.edge * train.period_us;
+	if (next_us < now_us + TIMESYNC_PULSE_MIN_LEAD_US) {
+		train.edge = (now_us + TIMESYNC_PULSE_MIN_LEAD_US - train.start_us) /
+			     train.period_us + 1;
+		next_us = train.start_us + (uint64_t)train.edge * train.period_us;
+	}
+
+	train.armed_us = controller_time_trigger_set(next_us);
+	train_timer_arm(now_us);
+
+	if (train.cb) {
+		train.cb(edge, edge_us);
+	}
+}
+
+int timesync_pulse_train_start(uint32_t period_us, timesync_pulse_edge_cb_t cb,
+			       uint64_t *first_us)
+{
+	uint64_t now_us;
+
+	if (period_us < TIMESYNC_PULSE_MIN_PERIOD_US) {
+		return -EINVAL;
+	}
+
+	timesync_pulse_train_stop();
+
+	now_us = controller_time_us_get();
+
+	train.cb = cb;
+	train.period_us = period_us;
+	train.start_us = ((now_us + TIMESYNC_PULSE_MIN_LEAD_US) / period_us + 1) * period_us;
+	train.edge = 0;
+	train.active = true;
+	train.armed_us = controller_time_trigger_set(train.start_us);
+	*first_us = train.armed_us;
+
+	train_timer_arm(now_us);
+
+	return 0;
+}
+
+void timesync_pulse_train_stop(void)
+{
+	k_timer_stop(&train_timer);
+	train.active = false;
+}
+
+bool timesync_pulse_train_active(void)
+{
+	return train.active;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TIMESYNC_PULSE_H__
+#define TIMESYNC_PULSE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** @brief Hand the timesync pin over to a GPIOTE toggle task.
+ *
+ * The controller time trigger event is connected to the task by (D)PPI, so a
+ * scheduled edge needs no CPU involvement.
+ *
+ * @return 0 on success, negative error code otherwise. On failure, the pin
+ *         and the GPIOTE channel are released again.
+ */
+int timesync_pulse_init(void);
+
+/** @brief Toggle the timesync pin now. */
+void timesync_pulse_toggle(void);
+
+/** @brief Toggle the timesync pin at the given controller time.
+ *
+ * @param timestamp_us In: requested controller time. Out: controller time at
+ *                     which the edge happens, after rounding to the timer
+ *                     resolution.
+ *
+ * @return 0 on success, -EINVAL if the time is too close or too far ahead.
+ */
+int timesync_pulse_schedule(uint64_t *timestamp_us);
+
+/** @brief Called from interrupt context for each edge of the pulse train.
+ *
+ * @param edge         Number of the edge on the grid since the train was
+ *                     started, skipped edges leave gaps.
+ * @param timestamp_us Controller time of the edge.
+ */
+typedef void (*timesync_pulse_edge_cb_t)(uint32_t edge, uint64_t timestamp_us);
+
+/** @brief Start a periodic pulse train on the timesync pin.
+ *
+ * The first edge is placed on the next multiple of the period in controller
+ * time. Each edge is scheduled in hardware; the next one is armed half a
+ * period after the previous edge, which is then reported. If arming is held
+ * off until an edge is too close, that edge is skipped and the edge numbers
+ * continue with the next one that can be armed.
+ *
+ * @param period_us    Time between two edges, at least 1 ms.
+ * @param cb           Edge callback, may be NULL.
+ * @param first_us     Out: controller time of the first edge.
+ *
+ * @return 0 on success, -EINVAL for a too short period.
+ */
+int timesync_pulse_train_start(uint32_t period_us, timesync_pulse_edge_cb_t cb,
+			       uint64_t *first_us);
+
+/** @brief Stop the pulse train. The edge that is already armed still happens. */
+void timesync_pulse_train_stop(void);
+
+/** @return true if a pulse train is running. */
+bool timesync_pulse_train_active(void);
+
+#endif
@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file records a binary trace of the packet flow
+ *
+ * Fixed size records go into a power of two ring without locking. The
+ * sequence number of a record is cleared before and set after its fields
+ * are written. A reader that finds the same, expected sequence number
+ * before and after copying a record has a consistent copy.
+ *
+ * Records are timestamped by k_cycle_get_32(), which keeps counting while
+ * the CPU sleeps, unlike the DWT cycle counter. A full controller time
+ * capture costs an IRQ lock and a TIMER capture per record. The reader
+ * gets one pair of cycle counter and controller time to convert the
+ * records with.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/barrier.h>
+#include <zephyr/sys/util.h>
+#include "controller_time.h"
+#include "prof.h"
+#include "trace.h"
+
+BUILD_ASSERT(IS_POWER_OF_TWO(TRACE_RECORDS), "Trace records must be a power of two");
+
+static struct trace_record trace_ring[TRACE_RECORDS];
+static atomic_t trace_head;
+static atomic_t trace_enabled = ATOMIC_INIT(1);
+
+void trace_write(enum trace_event event, uint16_t arg0, uint32_t arg1)
+{
+	struct trace_record *record;
+	uint32_t cycles;
+	uint32_t index;
+
+	if (!atomic_get(&trace_enabled)) {
+		return;
+	}
+
+	PROF_START(TRACE_WRITE);
+
+	/* Read the time before taking the index, so that a record never holds a
+	 * time after it became visible in the ring. A writer that preempts
+	 * between the two can still leave records slightly out of time order,
+	 * trace_dump.py takes the delta between records as signed.
+	 */
+	cycles = k_cycle_get_32();
+	index = atomic_inc(&trace_head);
+	record = &trace_ring[index & (TRACE_RECORDS - 1)];
+
+	record->seq = 0;
+	barrier_dmem_fence_full();
+	record->cycles = cycles;
+	record->event = event;
+	record->arg0 = arg0;
+	record->arg1 = arg1;
+	barrier_dmem_fence_full();
+	record->seq = index + 1;
+
+	PROF_STOP_LOCKED(TRACE_WRITE);
+}
+
+void trace_anchor_get(uint32_t *cycles_per_sec, uint32_t *cycles, uint64_t *time_us)
+{
+	unsigned int key;
+
+	*cycles_per_sec = sys_clock_hw_cycles_per_sec();
+
+	key = irq_lock();
+	*cycles = k_cycle_get_32();
+	*time_us = controller_time_us_get();
+	irq_unlock(key);
+}
+
+void trace_enable(bool enable)
+{
+	atomic_set(&trace_enabled, enable);
+}
+
+uint32_t trace_head_get(void)
+{
+	return atomic_get(&trace_head);
+}
+
+bool trace_read(uint32_t index, struct trace_record *record)
+{
+	const struct trace_record *slot = &trace_ring[index & (TRACE_RECORDS - 1)];
+	uint32_t seq = slot->seq;
+
+	barrier_dmem_fence_full();
+	*record = *slot;
+	barrier_dmem_fence_full();
+
+	return seq == index + 1 && slot->seq == seq && record->seq == seq;
+}
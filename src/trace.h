@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Event ids, keep in sync with scripts/trace_dump.py */
+enum trace_event {
+	/* h4_read(): bytes requested, bytes read */
+	TRACE_H4_READ = 1,
+	/* Packet from the host complete: H4 type, length */
+	TRACE_H2C_PACKET = 2,
+	/* Packet from the host dropped: enum trace_drop, H4 type */
+	TRACE_H2C_DROP = 3,
+	/* bt_send() returned: buffer type, error */
+	TRACE_BT_SEND = 4,
+	/* Packet queued for the host: buffer type, length */
+	TRACE_C2H_QUEUE = 5,
+	/* Packet taken by the UART TX engine: H4 type, length */
+	TRACE_C2H_START = 6,
+	/* Packet handed to the UART completely */
+	TRACE_C2H_SENT = 7,
+	/* Vendor event not sent for lack of a buffer: subevent, 0 */
+	TRACE_EVT_DROP = 8,
+	/* Receiving paused or resumed for lack of a buffer: 1 paused, 0 */
+	TRACE_RX_PAUSE = 9,
+	/* UART interrupt without RX or TX ready */
+	TRACE_UART_SPURIOUS = 10,
+	/* Timesync command handled: flags, status */
+	TRACE_TIMESYNC = 11,
+};
+
+enum trace_drop {
+	TRACE_DROP_NO_BUF = 1,
+	TRACE_DROP_TOO_LONG = 2,
+	TRACE_DROP_UNKNOWN_TYPE = 3,
+};
+
+struct trace_record {
+	/* Index of the record plus one once it is written completely */
+	uint32_t seq;
+	/* Lower 32 bits of the system cycle counter, see trace_anchor_get() */
+	uint32_t cycles;
+	uint16_t event;
+	uint16_t arg0;
+	uint32_t arg1;
+};
+
+#if defined(CONFIG_HCI_UART_TRACE)
+#define TRACE_RECORDS CONFIG_HCI_UART_TRACE_RECORDS
+
+/** @brief Write a record into the ring, from any context.
+ *
+ * The slot is reserved by an atomic increment of the write index, so
+ * writers preempting each other never share a slot. The oldest records
+ * are overwritten.
+ */
+void trace_write(enum trace_event event, uint16_t arg0, uint32_t arg1);
+
+/** @brief Pair the time base of the records with controller time.
+ *
+ * Records are timestamped by the system cycle counter, which is read much
+ * faster than the controller time. The host converts them to controller
+ * time by this pair.
+ *
+ * @param cycles_per_sec Out: frequency of the record time base.
+ * @param cycles         Out: lower 32 bits of the cycle counter.
+ * @param time_us        Out: controller time at the same moment.
+ */
+void trace_anchor_get(uint32_t *cycles_per_sec, uint32_t *cycles, uint64_t *time_us);
+
+/** @brief Stop or restart recording, e.g. to read a consistent snapshot. */
+void trace_enable(bool enable);
+
+/** @brief Index the next record will be written to. */
+uint32_t trace_head_get(void);
+
+/** @brief Copy a record if it is still in the ring.
+ *
+ * @param index  Index of the record.
+ * @param record Out: the record.
+ *
+ * @return false if the record has been overwritten or is being written.
+ */
+bool trace_read(uint32_t index, struct trace_record *record);
+
+#define TRACE(event, arg0, arg1) trace_write(TRACE_##event, (arg0), (arg1))
+#else
+#define TRACE(event, arg0, arg1)
+#endif /* CONFIG_HCI_UART_TRACE */
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** This file timestamps bytes on the HCI UART in hardware
+ *
+ * The UARTE RXDRDY or TXDRDY event counts the bytes per direction in a
+ * TIMER in counter mode. Its compare event, set to the number of the byte of
+ * interest, captures a free running 1 MHz TIMER through (D)PPI. Both events
+ * are generated at the end of a byte, so one character time is subtracted
+ * to get to the start bit. RXSTARTED and TXSTARTED only mark the start of a
+ * DMA transfer, which may hold several packets.
+ */
+
+#include <errno.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <nrfx_timer.h>
+#include <hal/nrf_uarte.h>
+#include <helpers/nrfx_gppi.h>
+#include <soc.h>
+#include "uart_timestamp.h"
+
+#define HCI_UART_NODE DT_CHOSEN(zephyr_bt_c2h_uart)
+
+#if defined(CONFIG_SOC_SERIES_NRF54LX)
+/* Same domain as the UARTE2x instances */
+#define UART_TIMESTAMP_TIMER		21
+#define UART_TIMESTAMP_RX_COUNTER	22
+#define UART_TIMESTAMP_TX_COUNTER	23
+#else
+#define UART_TIMESTAMP_TIMER		2
+#define UART_TIMESTAMP_RX_COUNTER	3
+#define UART_TIMESTAMP_TX_COUNTER	4
+#endif
+
+/* Start bit, 8 data bits and stop bit */
+#define UART_TIMESTAMP_CHAR_US \
+	DIV_ROUND_CLOSEST(10 * USEC_PER_SEC, DT_PROP(HCI_UART_NODE, current_speed))
+
+/* Compare channel of the counters, capture channels of the TIMER */
+#define COMPARE_CHANNEL		NRF_TIMER_CC_CHANNEL0
+#define NOW_CHANNEL		NRF_TIMER_CC_CHANNEL1
+
+static NRF_UARTE_Type *const uarte = (NRF_UARTE_Type *)DT_REG_ADDR(HCI_UART_NODE);
+static const nrfx_timer_t timer_instance = NRFX_TIMER_INSTANCE(UART_TIMESTAMP_TIMER);
+
+static const struct {
+	nrfx_timer_t counter;
+	nrf_uarte_event_t event;
+	nrf_timer_cc_channel_t latch_channel;
+	nrf_timer_task_t latch_task;
+	bool enabled;
+} dirs[] = {
+	[UART_TIMESTAMP_RX] = {
+#if defined(CONFIG_HCI_UART_RX_TIMESTAMP)
+		.counter = NRFX_TIMER_INSTANCE(UART_TIMESTAMP_RX_COUNTER),
+		.enabled = true,
+#endif
+		.event = NRF_UARTE_EVENT_RXDRDY,
+		.latch_channel = NRF_TIMER_CC_CHANNEL0,
+		.latch_task = NRF_TIMER_TASK_CAPTURE0,
+	},
+	[UART_TIMESTAMP_TX] = {
+#if defined(CONFIG_HCI_UART_TX_TIMESTAMP)
+		.counter = NRFX_TIMER_INSTANCE(UART_TIMESTAMP_TX_COUNTER),
+		.enabled = true,
+#endif
+		.event = NRF_UARTE_EVENT_TXDRDY,
+		.latch_channel = NRF_TIMER_CC_CHANNEL2,
+		.latch_task = NRF_TIMER_TASK_CAPTURE2,
+	},
+};
+
+static void unused_timer_isr_handler(nrf_timer_event_t event_type, void *ctx)
+{
+	ARG_UNUSED(event_type);
+	ARG_UNUSED(ctx);
+}
+
+static int timer_init(const nrfx_timer_t *instance, nrf_timer_mode_t mode)
+{
+	int ret;
+	const nrfx_timer_config_t timer_cfg = {
+		.frequency = NRFX_MHZ_TO_HZ(1UL),
+		.mode = mode,
+		.bit_width = NRF_TIMER_BIT_WIDTH_32,
+		.interrupt_priority = NRFX_TIMER_DEFAULT_CONFIG_IRQ_PRIORITY,
+		.p_context = NULL};
+
+	ret = nrfx_timer_init(instance, &timer_cfg, unused_timer_isr_handler);
+	if (ret != NRFX_SUCCESS) {
+		printk("Failed initializing timer (ret: %d)\n", ret - NRFX_ERROR_BASE_NUM);
+		return -ENODEV;
+	}
+
+	return 0;
+}
+
+static int counter_init(enum uart_timestamp_dir dir)
+{
+	int ret;
+	uint8_t ppi_chan_count;
+	uint8_t ppi_chan_capture_on_compare;
+	const nrfx_timer_t *counter = &dirs[dir].counter;
+
+	ret = timer_init(counter, NRF_TIMER_MODE_COUNTER);
+	if (ret) {
+		return ret;
+	}
+
+	if (nrfx_gppi_channel_alloc(&ppi_chan_count) != NRFX_SUCCESS ||
+	    nrfx_gppi_channel_alloc(&ppi_chan_capture_on_compare) != NRFX_SUCCESS) {
+		printk("Failed allocating for UART timestamp\n");
+		return -ENOMEM;
+	}
+
+	nrfx_gppi_channel_endpoints_setup(ppi_chan_count,
+					  nrf_uarte_event_address_get(uarte, dirs[dir].event),
+					  nrfx_timer_task_address_get(counter,
+								      NRF_TIMER_TASK_COUNT));
+
+	nrfx_gppi_channel_endpoints_setup(ppi_chan_capture_on_compare,
+					  nrfx_timer_event_address_get(counter,
+								       NRF_TIMER_EVENT_COMPARE0),
+					  nrfx_timer_task_address_get(&timer_instance,
+								      dirs[dir].latch_task));
+
+	nrfx_gppi_channels_enable(BIT(ppi_chan_count) | BIT(ppi_chan_capture_on_compare));
+
+	nrfx_timer_enable(counter);
+
+	return 0;
+}
+
+int uart_timestamp_init(void)
+{
+	int ret;
+
+	ret = timer_init(&timer_instance, NRF_TIMER_MODE_TIMER);
+	if (ret) {
+		return ret;
+	}
+
+	for (int dir = 0; dir < ARRAY_SIZE(dirs); dir++) {
+		if (!dirs[dir].enabled) {
+			continue;
+		}
+
+		ret = counter_init(dir);
+		if (ret) {
+			return ret;
+		}
+	}
+
+	nrfx_timer_enable(&timer_instance);
+
+	return 0;
+}
+
+bool uart_timestamp_arm(enum uart_timestamp_dir dir, uint32_t byte_count)
+{
+	NRF_TIMER_Type *counter = dirs[dir].counter.p_reg;
+	uint32_t count;
+
+	/* The previous compare value has been passed already and cannot match
+	 * again in between.
+	 */
+	nrf_timer_event_clear(counter, NRF_TIMER_EVENT_COMPARE0);
+	nrf_timer_cc_set(counter, COMPARE_CHANNEL, byte_count);
+
+	/* The compare only fires when the counter is incremented to the value */
+	count = nrfx_timer_capture(&dirs[dir].counter, NOW_CHANNEL);
+
+	return (int32_t)(count - byte_count) < 0 ||
+	       nrf_timer_event_check(counter, NRF_TIMER_EVENT_COMPARE0);
+}
+
+bool uart_timestamp_get(enum uart_timestamp_dir dir, uint32_t *ticks)
+{
+	if (!nrf_timer_event_check(dirs[dir].counter.p_reg, NRF_TIMER_EVENT_COMPARE0)) {
+		return false;
+	}
+
+	*ticks = nrf_timer_cc_get(timer_instance.p_reg, dirs[dir].latch_channel);
+
+	return true;
+}
+
+uint32_t uart_timestamp_now(void)
+{
+	return nrfx_timer_capture(&timer_instance, NOW_CHANNEL);
+}
+
+uint64_t uart_timestamp_to_controller_time(uint32_t ticks, uint64_t ref_us,
+					   uint32_t ref_ticks)
+{
+	return ref_us - (uint32_t)(ref_ticks - ticks) - UART_TIMESTAMP_CHAR_US;
+}
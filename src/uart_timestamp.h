@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef UART_TIMESTAMP_H__
+#define UART_TIMESTAMP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum uart_timestamp_dir {
+	/* Bytes received from the host, counted by RXDRDY */
+	UART_TIMESTAMP_RX,
+	/* Bytes sent to the host, counted by TXDRDY */
+	UART_TIMESTAMP_TX,
+};
+
+/** @brief Set up the hardware timestamping of bytes on the HCI UART.
+ *
+ * Per enabled direction, a TIMER in counter mode counts the RXDRDY or TXDRDY
+ * events of the UARTE. When it reaches the armed byte, a free running 1 MHz
+ * TIMER is captured by (D)PPI. Must be called before the UART is used.
+ *
+ * @return 0 on success, negative error code otherwise.
+ */
+int uart_timestamp_init(void);
+
+/** @brief Latch the time of the given byte.
+ *
+ * @param dir        Direction.
+ * @param byte_count Number of the byte since init, starting with 1.
+ *
+ * @return false if the byte has already been on the line before it could
+ *         be armed, so its time is not latched.
+ */
+bool uart_timestamp_arm(enum uart_timestamp_dir dir, uint32_t byte_count);
+
+/** @brief Get the latched time of the armed byte.
+ *
+ * @param dir   Direction.
+ * @param ticks Out: TIMER value when the byte was on the line.
+ *
+ * @return false if the armed byte has not been on the line yet.
+ */
+bool uart_timestamp_get(enum uart_timestamp_dir dir, uint32_t *ticks);
+
+/** @brief Capture the free running TIMER now. */
+uint32_t uart_timestamp_now(void);
+
+/** @brief Convert a latched time to controller time.
+ *
+ * The TIMER is not synchronized with the controller clock. A reference pair
+ * of controller time and TIMER value, captured right after each other, is
+ * used instead. Over the few milliseconds between the byte and the
+ * reference, the clock drift is far below 1 us.
+ *
+ * @param ticks       Latched TIMER value.
+ * @param ref_us      Controller time of the reference.
+ * @param ref_ticks   TIMER value of the reference.
+ *
+ * @return Controller time of the start bit of the byte.
+ */
+uint64_t uart_timestamp_to_controller_time(uint32_t ticks, uint64_t ref_us,
+					   uint32_t ref_ticks);
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** Tests of the H4 receive and transmit paths
+ *
+ * Recorded H4 streams are fed to the HCI UART through the UART emulator, in
+ * chunks of different sizes so that packets are split at every position,
+ * and the bytes the application sends back are compared with what the stub
+ * controller in src/hci_stub.c answers.
+ */
+
+#include <string.h>
+#include <zephyr/kernel.h>
+#include <zephyr/device.h>
+#include <zephyr/drivers/serial/uart_emul.h>
+#include <zephyr/ztest.h>
+
+/* main() of the application, renamed by the build */
+int hci_uart_main(void);
+
+K_THREAD_DEFINE(hci_uart_thread, 4096, hci_uart_main, NULL, NULL, NULL,
+		K_PRIO_PREEMPT(1), 0, 0);
+
+static const struct device *const uart_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_bt_c2h_uart));
+
+#define H4_TIMEOUT_MS	500
+
+/* HCI Reset and its Command Complete */
+static const uint8_t cmd_reset[] = { 0x01, 0x03, 0x0c, 0x00 };
+static const uint8_t evt_reset[] = { 0x04, 0x0e, 0x04, 0x01, 0x03, 0x0c, 0x00 };
+
+/* ACL data on handle 1, looped back by the stub and completed */
+static const uint8_t acl_out[] = {
+	0x02, 0x01, 0x00, 0x08, 0x00,
+	0x04, 0x00, 0x04, 0x00, 0xa0, 0xa1, 0xa2, 0xa3,
+};
+static const uint8_t evt_nocp[] = { 0x04, 0x13, 0x05, 0x01, 0x01, 0x00, 0x01, 0x00 };
+
+/* ISO data on handle 2, looped back by the stub */
+static const uint8_t iso_out[] = {
+	0x05, 0x02, 0x20, 0x08, 0x00,
+	0x00, 0x00, 0x04, 0x00, 0xb0, 0xb1, 0xb2, 0xb3,
+};
+
+/* ACL data longer than the ACL TX buffers, discarded */
+static uint8_t acl_too_long[5 + 0x40] = { 0x02, 0x01, 0x00, 0x40, 0x00 };
+
+/* Timesync command with the 32-bit format, the timestamp is not checked */
+static const uint8_t cmd_timesync[] = { 0x01, 0x00, 0xfe, 0x01, 0x00 };
+static const uint8_t evt_timesync[] = { 0x04, 0x0e, 0x08, 0x01, 0x00, 0xfe, 0x00 };
+#define EVT_TIMESYNC_LEN	(sizeof(evt_timesync) + sizeof(uint32_t))
+
+static void h4_feed(const uint8_t *data, size_t len, size_t chunk)
+{
+	while (len) {
+		size_t n = MIN(len, chunk);
+		uint32_t put = uart_emul_put_rx_data(uart_dev, data, n);
+
+		zassert_equal(put, n, "RX FIFO of the emulator is full");
+		data += n;
+		len -= n;
+
+		/* Let the application take the chunk before the next one */
+		k_msleep(1);
+	}
+}
+
+static void h4_read(uint8_t *data, size_t len)
+{
+	int64_t deadline = k_uptime_get() + H4_TIMEOUT_MS;
+	size_t got = 0;
+
+	while (got < len) {
+		got += uart_emul_get_tx_data(uart_dev, data + got, len - got);
+		if (got < len) {
+			zassert_true(k_uptime_get() < deadline,
+				     "Got %u of %u bytes", got, len);
+			k_msleep(1);
+		}
+	}
+}
+
+static void h4_expect(const uint8_t *expected, size_t len)
+{
+	uint8_t data[128];
+
+	zassert_true(len <= sizeof(data));
+	h4_read(data, len);
+	zassert_mem_equal(data, expected, len);
+}
+
+static void h4_expect_nothing_more(void)
+{
+	uint8_t data;
+
+	k_msleep(20);
+	zassert_equal(uart_emul_get_tx_data(uart_dev, &data, 1), 0,
+		      "Unexpected byte 0x%02x", data);
+}
+
+static void h4_reset(size_t chunk)
+{
+	h4_feed(cmd_reset, sizeof(cmd_reset), chunk);
+	h4_expect(evt_reset, sizeof(evt_reset));
+}
+
+static void h4_acl(size_t chunk)
+{
+	h4_feed(acl_out, sizeof(acl_out), chunk);
+	h4_expect(acl_out, sizeof(acl_out));
+	h4_expect(evt_nocp, sizeof(evt_nocp));
+}
+
+static void h4_iso(size_t chunk)
+{
+	h4_feed(iso_out, sizeof(iso_out), chunk);
+	h4_expect(iso_out, sizeof(iso_out));
+}
+
+static void h4_timesync(size_t chunk)
+{
+	uint8_t data[EVT_TIMESYNC_LEN];
+
+	h4_feed(cmd_timesync, sizeof(cmd_timesync), chunk);
+	h4_read(data, sizeof(data));
+	zassert_mem_equal(data, evt_timesync, sizeof(evt_timesync));
+}
+
+/* Whole packets, and split after every byte and every third byte */
+static const size_t chunks[] = { 1, 3, SIZE_MAX };
+
+static void h4_before(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	uart_emul_flush_rx_data(uart_dev);
+	uart_emul_flush_tx_data(uart_dev);
+}
+
+static void h4_after(void *fixture)
+{
+	ARG_UNUSED(fixture);
+
+	h4_expect_nothing_more();
+}
+
+ZTEST(h4_uart, test_cmd)
+{
+	ARRAY_FOR_EACH(chunks, i) {
+		h4_reset(chunks[i]);
+	}
+}
+
+ZTEST(h4_uart, test_acl)
+{
+	ARRAY_FOR_EACH(chunks, i) {
+		h4_acl(chunks[i]);
+	}
+}
+
+ZTEST(h4_uart, test_iso)
+{
+	ARRAY_FOR_EACH(chunks, i) {
+		h4_iso(chunks[i]);
+	}
+}
+
+ZTEST(h4_uart, test_timesync)
+{
+	ARRAY_FOR_EACH(chunks, i) {
+		h4_timesync(chunks[i]);
+	}
+}
+
+ZTEST(h4_uart, test_unknown_type)
+{
+	static const uint8_t unknown[] = { 0x07 };
+
+	/* The byte is dropped and the next packet is received normally */
+	ARRAY_FOR_EACH(chunks, i) {
+		h4_feed(unknown, sizeof(unknown), chunks[i]);
+		h4_reset(chunks[i]);
+	}
+}
+
+ZTEST(h4_uart, test_too_long)
+{
+	/* The payload is discarded and the next packet is received normally */
+	ARRAY_FOR_EACH(chunks, i) {
+		h4_feed(acl_too_long, sizeof(acl_too_long), chunks[i]);
+		h4_reset(chunks[i]);
+	}
+}
+
+ZTEST(h4_uart, test_session)
+{
+	uint8_t stream[sizeof(cmd_reset) + sizeof(acl_out) + sizeof(iso_out) +
+		       sizeof(cmd_timesync)];
+	uint8_t data[EVT_TIMESYNC_LEN];
+	size_t len = 0;
+
+	memcpy(&stream[len], cmd_reset, sizeof(cmd_reset));
+	len += sizeof(cmd_reset);
+	memcpy(&stream[len], acl_out, sizeof(acl_out));
+	len += sizeof(acl_out);
+	memcpy(&stream[len], iso_out, sizeof(iso_out));
+	len += sizeof(iso_out);
+	memcpy(&stream[len], cmd_timesync, sizeof(cmd_timesync));
+	len += sizeof(cmd_timesync);
+
+	/* Back to back, as a host would send it */
+	h4_feed(stream, len, SIZE_MAX);
+
+	h4_expect(evt_reset, sizeof(evt_reset));
+	h4_expect(acl_out, sizeof(acl_out));
+	h4_expect(evt_nocp, sizeof(evt_nocp));
+	h4_expect(iso_out, sizeof(iso_out));
+	h4_read(data, sizeof(data));
+	zassert_mem_equal(data, evt_timesync, sizeof(evt_timesync));
+}
+
+ZTEST_SUITE(h4_uart, NULL, NULL, h4_before, h4_after, NULL);
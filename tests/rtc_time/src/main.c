@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** Host tests of the RTC tick conversions in src/rtc_time.h
+ *
+ * Both directions are checked for every 32-bit input against the exact
+ * result in 64-bit arithmetic. One tick is exactly 30517578125 fs, i.e.
+ * 15625 / 512 us, so the rounded down result r of x ticks in us satisfies
+ * r * 512 <= x * 15625 < (r + 1) * 512, and the rounded down result r of
+ * x us in ticks satisfies r * 30517578125 <= x * 10^9 < (r + 1) * 30517578125.
+ * None of these products overflows 64 bits.
+ */
+
+#include <stdint.h>
+#include <zephyr/ztest.h>
+
+#include "rtc_time.h"
+
+#define FS_PER_TICK	30517578125ULL
+#define FS_PER_US	1000000000ULL
+
+ZTEST(rtc_time, test_ticks_to_us)
+{
+	uint64_t prev = 0;
+	uint32_t ticks = 0;
+
+	do {
+		uint64_t us = rtc_time_ticks_to_us(ticks);
+		uint64_t exact = (uint64_t)ticks * RTC_TIME_US_PER_TICK_NUM;
+
+		if (us * 512 > exact || (us + 1) * 512 <= exact) {
+			zassert_unreachable("%u ticks: %llu us", ticks, (unsigned long long)us);
+		}
+
+		/* The old formula, where it does not overflow */
+		if ((uint64_t)ticks <= UINT64_MAX / FS_PER_TICK) {
+			zassert_equal(us, (uint64_t)ticks * FS_PER_TICK / FS_PER_US,
+				      "%u ticks", ticks);
+		}
+
+		if (us < prev) {
+			zassert_unreachable("%u ticks: not monotonic", ticks);
+		}
+		prev = us;
+	} while (++ticks != 0);
+}
+
+ZTEST(rtc_time, test_us_to_ticks)
+{
+	uint32_t prev = 0;
+	uint32_t us = 0;
+
+	do {
+		uint64_t ticks = rtc_time_us_to_ticks(us);
+		uint64_t exact = (uint64_t)us * FS_PER_US;
+
+		if (ticks * FS_PER_TICK > exact || (ticks + 1) * FS_PER_TICK <= exact) {
+			zassert_unreachable("%u us: %llu ticks", us, (unsigned long long)ticks);
+		}
+
+		if (ticks < prev) {
+			zassert_unreachable("%u us: not monotonic", us);
+		}
+		prev = ticks;
+	} while (++us != 0);
+}
+
+ZTEST(rtc_time, test_edges)
+{
+	/* One tick, one RTC period of 2^24 ticks and the 32-bit ends */
+	zassert_equal(rtc_time_ticks_to_us(1), 30);
+	zassert_equal(rtc_time_ticks_to_us(1UL << 24), 512000000);
+	zassert_equal(rtc_time_ticks_to_us(UINT32_MAX), 131071999969ULL);
+	zassert_equal(rtc_time_us_to_ticks(30), 0);
+	zassert_equal(rtc_time_us_to_ticks(31), 1);
+	zassert_equal(rtc_time_us_to_ticks(512000000), 1UL << 24);
+	zassert_equal(rtc_time_us_to_ticks(UINT32_MAX), 140737488);
+}
+
+ZTEST_SUITE(rtc_time, NULL, NULL, NULL, NULL, NULL);
@@ -0,0 +1,129 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** Simulation of the RTC overflow handling of rtc_time_overflows_get()
+ *
+ * A simulated 24-bit RTC runs across the 512 s wrap. The overflow ISR runs a
+ * number of ticks after the wrap, or not at all while the reader keeps IRQs
+ * locked. The reader reads the counter, then checks the OVRFLW event some
+ * ticks later, so the wrap can also fall in between. Each reader result must
+ * match the simulated time of its counter read, and the overflows must be
+ * counted exactly once.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <zephyr/ztest.h>
+
+#include "rtc_time.h"
+
+#define RTC_COUNTER_RANGE	(1ULL << 24)
+
+/* Ticks around each wrap the reads are swept over */
+#define SWEEP_TICKS		16
+
+/* Never: the ISR does not run before the reads of a wrap, e.g. because it
+ * is preempted or IRQs are locked the whole time
+ */
+#define ISR_DELAY_NEVER		UINT32_MAX
+
+static struct {
+	uint64_t now;
+	bool overflow_event;
+	uint32_t num_overflows;
+} rtc;
+
+static void rtc_advance(uint64_t to)
+{
+	if (to / RTC_COUNTER_RANGE != rtc.now / RTC_COUNTER_RANGE) {
+		rtc.overflow_event = true;
+	}
+	rtc.now = to;
+}
+
+/* Same steps as the ISRs in the backends */
+static void rtc_overflow_isr(void)
+{
+	if (rtc.overflow_event) {
+		rtc.overflow_event = false;
+		rtc.num_overflows++;
+	}
+}
+
+/* Same steps as the readers in the backends, with IRQs locked */
+static uint64_t rtc_read(uint32_t check_delay)
+{
+	uint32_t ticks = rtc.now % RTC_COUNTER_RANGE;
+	bool overflow_pending;
+	uint32_t overflows;
+
+	rtc_advance(rtc.now + check_delay);
+	overflow_pending = rtc.overflow_event;
+	if (overflow_pending) {
+		rtc.overflow_event = false;
+	}
+	overflows = rtc_time_overflows_get(&rtc.num_overflows, ticks, overflow_pending);
+
+	return overflows * RTC_COUNTER_RANGE + ticks;
+}
+
+static void sweep_wrap(uint32_t wrap, uint32_t isr_delay, uint32_t check_delay)
+{
+	const uint64_t wrap_at = (uint64_t)wrap * RTC_COUNTER_RANGE;
+	uint64_t isr_at = isr_delay == ISR_DELAY_NEVER ? UINT64_MAX : wrap_at + isr_delay;
+	uint64_t prev = 0;
+
+	rtc.now = wrap_at - SWEEP_TICKS;
+	rtc.overflow_event = false;
+	rtc.num_overflows = wrap - 1;
+
+	while (rtc.now < wrap_at + SWEEP_TICKS) {
+		uint64_t read_at = rtc.now;
+		uint64_t result;
+
+		/* The ISR runs when due, unless the reader has IRQs locked */
+		if (isr_at <= read_at) {
+			rtc_overflow_isr();
+			isr_at = UINT64_MAX;
+		}
+
+		result = rtc_read(check_delay);
+		zassert_equal(result, read_at,
+			      "wrap %u, ISR delay %u, check delay %u: read at %llu gave %llu",
+			      wrap, isr_delay, check_delay, (unsigned long long)read_at,
+			      (unsigned long long)result);
+		zassert_true(result >= prev);
+		prev = result;
+
+		rtc_advance(rtc.now + 1);
+	}
+
+	/* The ISR finds nothing left if a reader counted the overflow */
+	rtc_overflow_isr();
+	zassert_equal(rtc.num_overflows, wrap, "wrap %u counted %u times", wrap,
+		      rtc.num_overflows - (wrap - 1));
+}
+
+ZTEST(rtc_overflow, test_wrap_sweep)
+{
+	static const uint32_t isr_delays[] = { 0, 1, 2, 7, ISR_DELAY_NEVER };
+	/* 1 and 2 ticks is much longer than the time between the counter read
+	 * and the event check, it makes the wrap fall in between
+	 */
+	static const uint32_t check_delays[] = { 0, 1, 2 };
+	/* The first wraps and the end of the 32-bit overflow count */
+	static const uint32_t wraps[] = { 1, 2, 3, 1000, UINT32_MAX };
+
+	ARRAY_FOR_EACH(wraps, w) {
+		ARRAY_FOR_EACH(isr_delays, i) {
+			ARRAY_FOR_EACH(check_delays, c) {
+				sweep_wrap(wraps[w], isr_delays[i], check_delays[c]);
+			}
+		}
+	}
+}
+
+ZTEST_SUITE(rtc_overflow, NULL, NULL, NULL, NULL, NULL);
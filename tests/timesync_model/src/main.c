@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2024 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+/** Host tests of the drift model in src/timesync_model.c
+ *
+ * Samples are generated for a controller clock that runs with a known skew
+ * against the host clock. Without noise, and with the skew and the sample
+ * interval chosen so that all offsets are whole microseconds, the fit must
+ * be exact. With noise, or where the integer arithmetic has to drop bits,
+ * it is compared against the same least squares fit in floating point.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+#include <zephyr/ztest.h>
+
+#include "timesync_model.h"
+
+/* Arbitrary host time and controller minus host time of the first sample */
+#define HOST_START_US	1700000000000000ULL
+#define OFFSET_START_US	-123456789LL
+
+/* Window limit of the model, see timesync_model_fit() */
+#define WINDOW_MAX_US	(15ULL * 60 * 1000000)
+
+/* Offset clamp and deviation saturation of the fit, see timesync_model.c */
+#define OFFSET_DELTA_MAX_US (1 << 30)
+#define RESIDUAL_MAX_NS 1000000000
+
+static struct timesync_model model;
+static struct timesync_model_fit fit;
+
+/* Floating point fit of the same samples */
+static struct {
+	double offset_ns;
+	double skew_ppb;
+	double residual_ns;
+	/* Mean host time relative to the newest sample */
+	double mean_ms;
+} ref;
+
+/* Controller time of a sample at host time start + t_us */
+static uint64_t controller_us(uint64_t t_us, int32_t skew_ppb, int32_t noise_us)
+{
+	return HOST_START_US + t_us + OFFSET_START_US +
+	       (int64_t)t_us * skew_ppb / 1000000000 + noise_us;
+}
+
+static void model_fill(int samples, uint64_t interval_us, int32_t skew_ppb,
+		       const int32_t *noise_us)
+{
+	timesync_model_reset(&model);
+	for (int i = 0; i < samples; i++) {
+		uint64_t t_us = i * interval_us;
+
+		timesync_model_add(&model, HOST_START_US + t_us,
+				   controller_us(t_us, skew_ppb, noise_us ? noise_us[i] : 0));
+	}
+}
+
+/* The same fit in floating point, over the same clamped offsets */
+static void reference_fit(void)
+{
+	const struct timesync_model_sample *newest =
+		&model.samples[(model.next + TIMESYNC_MODEL_SAMPLES - 1) % TIMESYNC_MODEL_SAMPLES];
+	double x[TIMESYNC_MODEL_SAMPLES];
+	double y[TIMESYNC_MODEL_SAMPLES];
+	double mx = 0, my = 0, sxx = 0, sxy = 0, srr = 0;
+	double slope;
+	int n = model.count;
+
+	for (int i = 0; i < n; i++) {
+		int64_t dy = model.samples[i].offset_us - newest->offset_us;
+
+		dy = dy > OFFSET_DELTA_MAX_US ? OFFSET_DELTA_MAX_US : dy;
+		dy = dy < -OFFSET_DELTA_MAX_US ? -OFFSET_DELTA_MAX_US : dy;
+		x[i] = ((int64_t)(model.samples[i].host_us - newest->host_us) / 1000);
+		y[i] = dy;
+		mx += x[i] / n;
+		my += y[i] / n;
+	}
+	for (int i = 0; i < n; i++) {
+		sxx += (x[i] - mx) * (x[i] - mx);
+		sxy += (x[i] - mx) * (y[i] - my);
+	}
+
+	/* us per ms */
+	slope = sxx ? sxy / sxx : 0;
+	for (int i = 0; i < n; i++) {
+		double r = y[i] - (my + slope * (x[i] - mx));
+
+		srr += r * r;
+	}
+
+	ref.offset_ns = (newest->offset_us + my - slope * mx) * 1000;
+	ref.skew_ppb = slope * 1000000;
+	ref.residual_ns = sqrt(srr / n) * 1000;
+	ref.mean_ms = mx;
+}
+
+/* The skew is truncated to whole ppb. The offset is extrapolated with it
+ * from the mean host time, so it may be off by a ppb of that time.
+ */
+static double offset_tolerance_ns(void)
+{
+	return fabs(ref.mean_ms) / 1000 + 1;
+}
+
+static void check_exact(int samples, int32_t skew_ppb)
+{
+	uint64_t newest_t_us = (samples - 1) * 1000000ULL;
+
+	/* One sample per second, offsets are whole microseconds for skews in
+	 * whole ppm
+	 */
+	model_fill(samples, 1000000, skew_ppb, NULL);
+	timesync_model_fit(&model, &fit);
+
+	zassert_equal(fit.samples, MIN(samples, TIMESYNC_MODEL_SAMPLES));
+	zassert_equal(fit.skew_ppb, skew_ppb, "%d samples, %d ppb: %d ppb", samples, skew_ppb,
+		      fit.skew_ppb);
+	zassert_equal(fit.offset_ns, (int64_t)(controller_us(newest_t_us, skew_ppb, 0) -
+					       (HOST_START_US + newest_t_us)) * 1000,
+		      "%d samples, %d ppb: %lld ns", samples, skew_ppb,
+		      (long long)fit.offset_ns);
+	zassert_equal(fit.residual_ns, 0);
+}
+
+ZTEST(timesync_model, test_exact_skew)
+{
+	static const int32_t skews_ppb[] = {
+		0, 1000, -1000, 25000, -40000, 100000, -500000, 2000000,
+	};
+
+	ARRAY_FOR_EACH(skews_ppb, i) {
+		/* Exact from the second sample on, and after the ring wrapped */
+		for (int samples = 2; samples <= TIMESYNC_MODEL_SAMPLES + 3; samples++) {
+			check_exact(samples, skews_ppb[i]);
+		}
+	}
+}
+
+ZTEST(timesync_model, test_single_sample)
+{
+	model_fill(1, 0, 0, NULL);
+	timesync_model_fit(&model, &fit);
+
+	zassert_equal(fit.samples, 1);
+	zassert_equal(fit.skew_ppb, 0);
+	zassert_equal(fit.offset_ns, OFFSET_START_US * 1000);
+	zassert_equal(fit.residual_ns, 0);
+
+	timesync_model_reset(&model);
+	timesync_model_fit(&model, &fit);
+	zassert_equal(fit.samples, 0);
+}
+
+ZTEST(timesync_model, test_reset_on_host_time_step)
+{
+	/* Host time that does not advance, and host time stepped back */
+	static const int64_t steps_us[] = { 0, -1, -1000000 };
+
+	ARRAY_FOR_EACH(steps_us, i) {
+		uint64_t newest_host_us = HOST_START_US + 3 * 1000000ULL;
+		uint64_t host_us = newest_host_us + steps_us[i];
+
+		model_fill(4, 1000000, 50000, NULL);
+		timesync_model_add(&model, host_us, host_us + 777);
+		timesync_model_fit(&model, &fit);
+
+		zassert_equal(fit.samples, 1, "step %lld us", (long long)steps_us[i]);
+		zassert_equal(fit.skew_ppb, 0);
+		zassert_equal(fit.offset_ns, 777000);
+
+		/* The model continues from the new sample only */
+		timesync_model_add(&model, host_us + 1000000, host_us + 1000000 + 777 + 3);
+		timesync_model_fit(&model, &fit);
+
+		zassert_equal(fit.samples, 2);
+		zassert_equal(fit.skew_ppb, 3000);
+		zassert_equal(fit.offset_ns, 780000);
+	}
+}
+
+ZTEST(timesync_model, test_window_limit)
+{
+	static const int32_t skews_ppb[] = { 100000, -100000, 1000000 };
+	/* Spread over the whole window, in whole 10 ms steps */
+	uint64_t interval_us = WINDOW_MAX_US / (TIMESYNC_MODEL_SAMPLES - 1) / 10000 * 10000;
+
+	ARRAY_FOR_EACH(skews_ppb, i) {
+		model_fill(TIMESYNC_MODEL_SAMPLES, interval_us, skews_ppb[i], NULL);
+		timesync_model_fit(&model, &fit);
+		reference_fit();
+
+		/* The divisor is shifted down this far out, which may cost a
+		 * ppb
+		 */
+		zassert_true(llabs(fit.skew_ppb - skews_ppb[i]) <= 1, "%d ppb: %d ppb",
+			     skews_ppb[i], fit.skew_ppb);
+		zassert_true(fabs(fit.offset_ns - ref.offset_ns) <= offset_tolerance_ns(),
+			     "%d ppb: %lld ns, %f ns", skews_ppb[i], (long long)fit.offset_ns,
+			     ref.offset_ns);
+		zassert_true(fit.residual_ns <= 1000, "%d ppb: residual %u ns", skews_ppb[i],
+			     fit.residual_ns);
+	}
+}
+
+ZTEST(timesync_model, test_offset_clamp)
+{
+	/* Controller time jumps by more than the clamp between two samples */
+	static const int64_t jumps_us[] = { 2LL * OFFSET_DELTA_MAX_US, -2LL * OFFSET_DELTA_MAX_US };
+
+	ARRAY_FOR_EACH(jumps_us, i) {
+		timesync_model_reset(&model);
+		timesync_model_add(&model, HOST_START_US, HOST_START_US);
+		timesync_model_add(&model, HOST_START_US + 1000000,
+				   HOST_START_US + 1000000 + jumps_us[i]);
+		timesync_model_fit(&model, &fit);
+
+		/* 2^30 us in 1 s is far beyond the skew range */
+		zassert_equal(fit.skew_ppb, jumps_us[i] > 0 ? INT32_MAX : INT32_MIN,
+			      "jump %lld us: %d ppb", (long long)jumps_us[i], fit.skew_ppb);
+	}
+
+	/* Over the whole window, the clamped jump is a skew within range */
+	ARRAY_FOR_EACH(jumps_us, i) {
+		uint64_t interval_us = WINDOW_MAX_US / (TIMESYNC_MODEL_SAMPLES - 1) / 1000 * 1000;
+		timesync_model_reset(&model);
+		timesync_model_add(&model, HOST_START_US, HOST_START_US);
+		for (int s = 1; s < TIMESYNC_MODEL_SAMPLES; s++) {
+			uint64_t host_us = HOST_START_US + s * interval_us;
+
+			timesync_model_add(&model, host_us, host_us + jumps_us[i]);
+		}
+		timesync_model_fit(&model, &fit);
+		reference_fit();
+
+		zassert_true((fit.skew_ppb > 0) == (jumps_us[i] > 0));
+		zassert_true(fabs(fit.skew_ppb - ref.skew_ppb) <= 1, "jump %lld us: %d ppb, %f ppb",
+			     (long long)jumps_us[i], fit.skew_ppb, ref.skew_ppb);
+		zassert_true(fabs(fit.offset_ns - ref.offset_ns) <= offset_tolerance_ns(),
+			     "jump %lld us: %lld ns, %f ns", (long long)jumps_us[i],
+			     (long long)fit.offset_ns, ref.offset_ns);
+		/* Deviations are saturated at 1 s before squaring. Two samples
+		 * are always on the line.
+		 */
+		zassert_true(TIMESYNC_MODEL_SAMPLES == 2 || ref.residual_ns > RESIDUAL_MAX_NS);
+		zassert_true(fit.residual_ns <= RESIDUAL_MAX_NS,
+			     "jump %lld us: residual %u ns", (long long)jumps_us[i],
+			     fit.residual_ns);
+	}
+}
+
+ZTEST(timesync_model, test_noise)
+{
+	static const int32_t skews_ppb[] = { 0, 20000, -75000 };
+	static const uint64_t intervals_us[] = { 1000000, 60000000 };
+	int32_t noise_us[TIMESYNC_MODEL_SAMPLES];
+	uint32_t lcg = 1;
+
+	ARRAY_FOR_EACH(skews_ppb, i) {
+		ARRAY_FOR_EACH(intervals_us, j) {
+				/* Up to +-100 us, e.g. USB or scheduling jitter */
+			for (int s = 0; s < TIMESYNC_MODEL_SAMPLES; s++) {
+				lcg = lcg * 1103515245 + 12345;
+				noise_us[s] = (int32_t)((lcg >> 16) % 201) - 100;
+			}
+
+			model_fill(TIMESYNC_MODEL_SAMPLES, intervals_us[j], skews_ppb[i],
+				   noise_us);
+			timesync_model_fit(&model, &fit);
+			reference_fit();
+
+			zassert_true(TIMESYNC_MODEL_SAMPLES == 2 || ref.residual_ns > 1000,
+				     "no noise in the samples");
+			zassert_true(fabs(fit.skew_ppb - ref.skew_ppb) <= 1,
+				     "%d ppb: %d ppb, %f ppb", skews_ppb[i], fit.skew_ppb,
+				     ref.skew_ppb);
+			zassert_true(fabs(fit.offset_ns - ref.offset_ns) <= offset_tolerance_ns(),
+				     "%d ppb: %lld ns, %f ns", skews_ppb[i],
+				     (long long)fit.offset_ns, ref.offset_ns);
+			/* The deviations are taken from the truncated line and
+			 * in whole ns
+			 */
+			zassert_true(fabs(fit.residual_ns - ref.residual_ns) <=
+				     offset_tolerance_ns() + 1,
+				     "%d ppb: residual %u ns, %f ns", skews_ppb[i],
+				     fit.residual_ns, ref.residual_ns);
+		}
+	}
+}
+
+ZTEST_SUITE(timesync_model, NULL, NULL, NULL, NULL, NULL);